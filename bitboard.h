@@ -0,0 +1,337 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+#include "rotationData.h"
+
+// board dimensions
+#define BOARD_WIDTH 10
+#define BOARD_HEIGHT 20
+// row with all ten columns filled
+#define FULL_ROW 0x3FF
+
+// packed playfield: one 10-bit row per word
+// bit x of rows[y] is the tile at column x, row y (row 0 = bottom)
+// the whole board is 48 bytes, so copying it is a plain struct assignment
+// hash is the Zobrist hash of the filled cells, kept up to date by every
+// function below (an empty board hashes to 0)
+struct Bitboard {
+	uint16_t rows[BOARD_HEIGHT];
+	uint64_t hash;
+};
+
+// Zobrist keys, built at compile time
+// each cell gets a random 64-bit key; a row's key is the xor of the keys
+// of its filled cells, stored per 5-column half so any row value is two
+// lookups: keys[y][0][low 5 bits] ^ keys[y][1][high 5 bits]
+struct ZobristTable {
+	uint64_t keys[BOARD_HEIGHT][2][32];
+
+	static constexpr uint64_t cellKey(int x, int y) {
+		// splitmix64 of the cell index
+		uint64_t z = 0x9E3779B97F4A7C15ULL * (uint64_t) (y * BOARD_WIDTH + x + 1);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	constexpr ZobristTable() : keys() {
+		for (int y = 0; y < BOARD_HEIGHT; ++y) {
+			for (int half = 0; half < 2; ++half) {
+				for (int bits = 0; bits < 32; ++bits) {
+					for (int i = 0; i < 5; ++i) {
+						if ((bits >> i) & 1) {
+							keys[y][half][bits] ^= cellKey(half*5 + i, y);
+						}
+					}
+				}
+			}
+		}
+	}
+};
+
+inline constexpr ZobristTable zobrist;
+
+inline uint64_t rowKey(int y, uint16_t row) {
+	return zobrist.keys[y][0][row & 31] ^ zobrist.keys[y][1][row >> 5];
+}
+
+// hash of a board from scratch, used to check the incremental updates
+inline uint64_t boardHash(const Bitboard& board) {
+	uint64_t hash = 0;
+	for (int i = 0; i < BOARD_HEIGHT; ++i) {
+		hash ^= rowKey(i, board.rows[i]);
+	}
+	return hash;
+}
+
+// footprint of a piece as row masks
+// x: leftmost column, y: bottom row, rows[0] is the bottom row of the piece
+struct PieceMask {
+	uint16_t rows[4];
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+inline void clearBoard(Bitboard& board) {
+	for (int i = 0; i < BOARD_HEIGHT; ++i) {
+		board.rows[i] = 0;
+	}
+	board.hash = 0;
+}
+
+inline bool getCell(const Bitboard& board, int x, int y) {
+	return (board.rows[y] >> x) & 1;
+}
+
+inline void setCell(Bitboard& board, int x, int y) {
+	if (!getCell(board, x, y)) {
+		board.rows[y] |= 1 << x;
+		board.hash ^= ZobristTable::cellKey(x, y);
+	}
+}
+
+inline PieceMask makeMask(const int cells[4][2]) {
+	/*
+		Packs the four tiles of a piece into row masks.
+		Parameters:
+			cells (int[4][2]): x, y coordinates of each tile
+	*/
+	PieceMask mask;
+	int minX = cells[0][0], maxX = cells[0][0];
+	int minY = cells[0][1], maxY = cells[0][1];
+	for (int i = 1; i < 4; ++i) {
+		if (cells[i][0] < minX) minX = cells[i][0];
+		if (cells[i][0] > maxX) maxX = cells[i][0];
+		if (cells[i][1] < minY) minY = cells[i][1];
+		if (cells[i][1] > maxY) maxY = cells[i][1];
+	}
+	for (int i = 0; i < 4; ++i) {
+		mask.rows[i] = 0;
+	}
+	for (int i = 0; i < 4; ++i) {
+		mask.rows[cells[i][1] - minY] |= 1 << (cells[i][0] - minX);
+	}
+	mask.x = minX;
+	mask.y = minY;
+	mask.width = maxX - minX + 1;
+	mask.height = maxY - minY + 1;
+	return mask;
+}
+
+inline bool collides(const Bitboard& board, const PieceMask& mask, int directionX, int directionY) {
+	/*
+		Tests a piece against the walls, floor, ceiling and locked tiles.
+		Parameters:
+			board (Bitboard): board to test against
+			mask (PieceMask): piece footprint
+			directionX (int): horizontal offset to test at
+			directionY (int): vertical offset to test at
+	*/
+	int x = mask.x + directionX;
+	int y = mask.y + directionY;
+	if (x < 0 || x + mask.width > BOARD_WIDTH || y < 0 || y + mask.height > BOARD_HEIGHT) {
+		return true;
+	}
+	for (int i = 0; i < mask.height; ++i) {
+		if (board.rows[y + i] & (mask.rows[i] << x)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// footprint of a piece from the rotation tables, pivot at (pivotX, pivotY)
+inline PieceMask shapeMask(int piece, int rot, int pivotX, int pivotY) {
+	const PieceShape& shape = pieceShapes[piece][rot];
+	PieceMask mask;
+	for (int i = 0; i < 4; ++i) {
+		mask.rows[i] = shape.rows[i];
+	}
+	mask.x = pivotX + shape.left;
+	mask.y = pivotY + shape.bottom;
+	mask.width = shape.width;
+	mask.height = shape.height;
+	return mask;
+}
+
+inline bool tryRotate(const Bitboard& board, int piece, int& rot, int& pivotX, int& pivotY, int clockwise) {
+	/*
+		Turns a piece using the SRS kick tables.
+		Parameters:
+			board (Bitboard): board to test against
+			piece (int): piece index
+			rot (int&): rotation index, updated on success
+			pivotX, pivotY (int&): pivot position, updated on success
+			clockwise (int): 1 for CW, -1 for CCW
+		Returns false and leaves the piece alone if every kick collides.
+	*/
+	int newRot = (rot + clockwise + 4) % 4;
+	const int8_t (*kicks)[2] = rotationKicks[piece][rot][clockwise == 1 ? 0 : 1];
+	PieceMask mask = shapeMask(piece, newRot, pivotX, pivotY);
+	for (int i = 0; i < 5; ++i) {
+		if (!collides(board, mask, kicks[i][0], kicks[i][1])) {
+			rot = newRot;
+			pivotX += kicks[i][0];
+			pivotY += kicks[i][1];
+			return true;
+		}
+	}
+	return false;
+}
+
+// number of rows a piece falls before it lands
+inline int dropDistance(const Bitboard& board, const PieceMask& mask, int directionX) {
+	int drop = 0;
+	while (!collides(board, mask, directionX, -(drop + 1))) {
+		drop++;
+	}
+	return drop;
+}
+
+// lowest tile of each column of every footprint, as a row offset from the
+// footprint's bottom row (-1 past its width); built at compile time
+struct BottomProfiles {
+	int8_t bottoms[7][4][4];
+
+	constexpr BottomProfiles() : bottoms() {
+		for (int piece = 0; piece < 7; ++piece) {
+			for (int rot = 0; rot < 4; ++rot) {
+				const PieceShape& shape = pieceShapes[piece][rot];
+				for (int column = 0; column < 4; ++column) {
+					bottoms[piece][rot][column] = -1;
+					for (int i = shape.height - 1; i >= 0; --i) {
+						if ((shape.rows[i] >> column) & 1) {
+							bottoms[piece][rot][column] = i;
+						}
+					}
+				}
+			}
+		}
+	}
+};
+
+inline constexpr BottomProfiles bottomProfiles;
+
+// first rotation with the same footprint as each rotation: O has one
+// footprint and I, S and Z have two, so two placements of a piece fill the
+// same cells exactly when their canonical rotations and masks match
+struct CanonicalRotations {
+	int8_t rots[7][4];
+
+	constexpr CanonicalRotations() : rots() {
+		for (int piece = 0; piece < 7; ++piece) {
+			for (int rot = 0; rot < 4; ++rot) {
+				rots[piece][rot] = rot;
+				for (int i = rot - 1; i >= 0; --i) {
+					const PieceShape& a = pieceShapes[piece][i];
+					const PieceShape& b = pieceShapes[piece][rot];
+					if (a.width == b.width && a.height == b.height && a.rows[0] == b.rows[0]
+							&& a.rows[1] == b.rows[1] && a.rows[2] == b.rows[2] && a.rows[3] == b.rows[3]) {
+						rots[piece][rot] = i;
+					}
+				}
+			}
+		}
+	}
+};
+
+inline constexpr CanonicalRotations canonicalRotations;
+
+// skyline: one above the highest tile of each column, 0 if the column is
+// empty (the same numbers TrackedBoard keeps up to date)
+inline void columnTops(const Bitboard& board, int8_t* tops) {
+	uint16_t seen = 0;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		tops[i] = 0;
+	}
+	for (int y = BOARD_HEIGHT - 1; y >= 0 && seen != FULL_ROW; --y) {
+		uint16_t fresh = board.rows[y] & ~seen;
+		seen |= fresh;
+		while (fresh) {
+			tops[__builtin_ctz(fresh)] = y + 1;
+			fresh &= fresh - 1;
+		}
+	}
+}
+
+inline int landingDistance(const Bitboard& board, const int8_t* tops, int piece, int rot, const PieceMask& mask, int directionX) {
+	/*
+		dropDistance from the skyline: a piece whose lowest tile in every
+		column is above that column's top lands where the first of them
+		meets the skyline, in one step per column. A piece under an
+		overhang falls back to the row-by-row walk.
+		Parameters:
+			board (Bitboard): board to drop onto
+			tops (int8_t*): its columnTops
+			piece, rot (int): footprint of mask, for its bottom profile
+			mask (PieceMask): piece to drop
+			directionX (int): horizontal offset to drop at
+	*/
+	const int8_t* bottom = bottomProfiles.bottoms[piece][rot];
+	int x = mask.x + directionX;
+	int rest = 0;
+	for (int i = 0; i < mask.width; ++i) {
+		if (tops[x + i] > mask.y + bottom[i]) {
+			return dropDistance(board, mask, directionX);
+		}
+		if (rest < tops[x + i] - bottom[i]) {
+			rest = tops[x + i] - bottom[i];
+		}
+	}
+	return mask.y - rest;
+}
+
+// ors a piece into the board
+inline void lockMask(Bitboard& board, const PieceMask& mask, int directionX, int directionY) {
+	int x = mask.x + directionX;
+	int y = mask.y + directionY;
+	for (int i = 0; i < mask.height; ++i) {
+		// the piece never overlaps locked tiles, so its cells are new
+		board.hash ^= rowKey(y + i, mask.rows[i] << x);
+		board.rows[y + i] |= mask.rows[i] << x;
+	}
+}
+
+inline int clearLines(Bitboard& board, int fromRow, int toRow) {
+	/*
+		Removes full rows and shifts everything above them down.
+		Only rows in [fromRow, toRow) can be full after a lock, so only
+		those are tested.
+		Parameters:
+			board (Bitboard): board to update
+			fromRow (int): lowest row touched by the last lock
+			toRow (int): one past the highest row touched by the last lock
+		Returns the number of cleared lines.
+	*/
+	int cleared = 0;
+	for (int i = fromRow; i < toRow; ++i) {
+		if (board.rows[i] == FULL_ROW) {
+			cleared++;
+		}
+	}
+	if (cleared == 0) {
+		return 0;
+	}
+	// every row from fromRow up may move, so rehash the ones that change
+	int dest = fromRow;
+	for (int i = fromRow; i < BOARD_HEIGHT; ++i) {
+		if (board.rows[i] != FULL_ROW || i >= toRow) {
+			if (dest != i) {
+				board.hash ^= rowKey(dest, board.rows[dest]) ^ rowKey(dest, board.rows[i]);
+				board.rows[dest] = board.rows[i];
+			}
+			dest++;
+		}
+	}
+	while (dest < BOARD_HEIGHT) {
+		board.hash ^= rowKey(dest, board.rows[dest]);
+		board.rows[dest++] = 0;
+	}
+	return cleared;
+}
+
+#endif
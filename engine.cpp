@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstring>
+
+#include "engine.h"
+#include "evaluate.h"
+#include "reachability.h"
+#include "search.h"
+#include "threadPool.h"
+#include "transposition.h"
+
+using namespace std;
+
+// the public limits are copies of the internal ones, so the header needs
+// nothing else
+static_assert(ENGINE_WIDTH == BOARD_WIDTH && ENGINE_HEIGHT == BOARD_HEIGHT, "board size");
+static_assert(ENGINE_MAX_PREVIEW == MAX_PLIES - 1, "lookahead");
+static_assert(ENGINE_MAX_PATH == MAX_PATH, "path length");
+static_assert(ENGINE_MAX_CHANCE_PLIES == MAX_CHANCE_PLIES, "expectimax depth");
+static_assert(ENGINE_LEFT == PATH_LEFT && ENGINE_RIGHT == PATH_RIGHT && ENGINE_CW == PATH_CW
+	&& ENGINE_CCW == PATH_CCW && ENGINE_DROP == PATH_DROP, "path inputs");
+
+// slices per thread in a batch: enough to even out slow decisions, few
+// enough that a slice's task costs nothing next to its searches
+#define SLICES_PER_THREAD 4
+
+struct Engine {
+	ThreadPool pool;
+	TranspositionTable* table;
+	Weights weights;
+	int chancePlies;
+	bool mirrored;
+	bool monteCarlo;
+
+	explicit Engine(int threads) : pool(threads), table(0), weights(defaultWeights), chancePlies(0), mirrored(false),
+		monteCarlo(false) {}
+	~Engine() {
+		delete table;
+	}
+};
+
+static bool validRequest(const EngineRequest& request) {
+	if (request.piece < 0 || request.piece > 6 || request.numPreview < 0 || request.numPreview > ENGINE_MAX_PREVIEW
+			|| !(request.budget >= 0)) {
+		return false;
+	}
+	for (int i = 0; i < request.numPreview; ++i) {
+		if (request.preview[i] < 0 || request.preview[i] > 6) {
+			return false;
+		}
+	}
+	for (int y = 0; y < BOARD_HEIGHT; ++y) {
+		if (request.rows[y] & ~FULL_ROW) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void decide(const Engine& engine, ThreadPool* pool, const EngineRequest& request, EngineMove& move) {
+	/*
+		Searches one request.
+		Parameters:
+			engine (Engine): table and weights to search with
+			pool (ThreadPool*): spreads the subtrees, or 0 to search them on
+				the calling thread
+			request (EngineRequest): position to decide
+			move (EngineMove): out, the answer
+	*/
+	memset(&move, 0, sizeof(move));
+	if (!validRequest(request)) {
+		move.status = ENGINE_BAD_REQUEST;
+		return;
+	}
+	Bitboard board;
+	memcpy(board.rows, request.rows, sizeof(board.rows));
+	board.hash = boardHash(board);
+	int pieces[MAX_PLIES];
+	pieces[0] = request.piece;
+	for (int i = 0; i < request.numPreview; ++i) {
+		pieces[i + 1] = request.preview[i];
+	}
+	SearchContext context = {pool, engine.table, &engine.weights, 0, request.paths != 0, engine.mirrored,
+		engine.chancePlies, 0, request.budget, engine.monteCarlo};
+	SearchResult result = searchMove(board, pieces, request.numPreview + 1, context);
+	move.candidates = result.candidates;
+	if (!result.found) {
+		move.status = ENGINE_NO_MOVE;
+		return;
+	}
+	move.status = ENGINE_OK;
+	move.rot = result.move.rot;
+	move.pivotX = result.move.pivotX;
+	move.pivotY = result.move.pivotY;
+	move.moveInstr = result.moveInstr;
+	move.score = result.score;
+	if (context.reachable) {
+		move.pathLength = max(0, findPath(board, request.piece, result.move, move.path));
+	}
+}
+
+int engineApiVersion(void) {
+	return ENGINE_API_VERSION;
+}
+
+Engine* createEngine(const EngineConfig* config) {
+	Engine* engine = new Engine(config ? config->threads : 0);
+	if (config && config->weightsFile && !loadWeights(config->weightsFile, engine->weights)) {
+		delete engine;
+		return 0;
+	}
+	if (config && config->tableBits > 0) {
+		engine->table = new TranspositionTable(config->tableBits);
+	}
+	if (config) {
+		engine->chancePlies = min(max(config->chancePlies, 0), MAX_CHANCE_PLIES);
+		engine->mirrored = config->mirrored != 0;
+		engine->monteCarlo = config->monteCarlo != 0;
+	}
+	return engine;
+}
+
+void destroyEngine(Engine* engine) {
+	delete engine;
+}
+
+int engineLoadWeights(Engine* engine, const char* weightsFile) {
+	// as in createEngine, weights the file does not name keep their defaults
+	Weights weights = defaultWeights;
+	if (!loadWeights(weightsFile, weights)) {
+		return 0;
+	}
+	engine->weights = weights;
+	// cached values were scored with the old weights
+	if (engine->table) {
+		engine->table->clear();
+	}
+	return 1;
+}
+
+int engineDecide(Engine* engine, const EngineRequest* request, EngineMove* move) {
+	decide(*engine, &engine->pool, *request, *move);
+	return move->status;
+}
+
+int engineDecideBatch(Engine* engine, const EngineRequest* requests, EngineMove* moves, int count) {
+	/*
+		Spreads a batch over the engine's threads in a few slices per
+		thread, one pool task per slice rather than per decision or per
+		subtree. Batches smaller than the pool still split each search
+		over the threads.
+		Parameters:
+			engine (Engine): engine to decide with
+			requests (EngineRequest*): positions to decide
+			moves (EngineMove*): out, one answer per request
+			count (int): number of requests
+	*/
+	int threads = engine->pool.size();
+	ThreadPool* nested = count < threads ? &engine->pool : 0;
+	int slices = min(count, threads * SLICES_PER_THREAD);
+	TaskGroup group;
+	for (int slice = 0; slice < slices; ++slice) {
+		int first = (long) count * slice / slices;
+		int last = (long) count * (slice + 1) / slices;
+		engine->pool.submit(group, [=]() {
+			for (int i = first; i < last; ++i) {
+				decide(*engine, nested, requests[i], moves[i]);
+			}
+		});
+	}
+	engine->pool.wait(group);
+	int found = 0;
+	for (int i = 0; i < count; ++i) {
+		if (moves[i].status == ENGINE_OK) {
+			found++;
+		}
+	}
+	return found;
+}
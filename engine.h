@@ -0,0 +1,101 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+
+// embeddable AI: the server's search and evaluation behind a C interface,
+// for simulators and training jobs that decide in-process
+// an engine owns its worker threads, transposition table and weights;
+// decisions on one engine may be made from several threads at once, but
+// not while its weights are being replaced
+// the structs below only ever grow at the end, and ENGINE_API_VERSION goes
+// up when they do
+
+#define ENGINE_API_VERSION 2
+
+#define ENGINE_WIDTH 10
+#define ENGINE_HEIGHT 20
+#define ENGINE_MAX_PREVIEW 3	// upcoming pieces a decision looks ahead through
+#define ENGINE_MAX_PATH 25	// inputs in the longest path
+#define ENGINE_MAX_CHANCE_PLIES 3	// unknown pieces a decision can average over
+
+// EngineMove status
+#define ENGINE_OK 0
+#define ENGINE_NO_MOVE 1	// the piece cannot spawn: the game is lost
+#define ENGINE_BAD_REQUEST 2	// piece index, board or budget out of range
+
+// path inputs, the same codes as a 'P' reply
+#define ENGINE_LEFT 0
+#define ENGINE_RIGHT 1
+#define ENGINE_CW 2
+#define ENGINE_CCW 3
+#define ENGINE_DROP 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct EngineConfig {
+	int threads;	// worker threads, 0 for one per core
+	int tableBits;	// transposition table of 2^tableBits slots, 0 for none
+	const char* weightsFile;	// evaluation weights, the compiled-in defaults if null
+	// version 2
+	// unknown pieces past the preview each decision averages over
+	// (expectimax), at most ENGINE_MAX_CHANCE_PLIES
+	int chancePlies;
+	int mirrored;	// nonzero: mirror images share table entries, as in the server
+	int monteCarlo;	// nonzero: Monte Carlo tree search in place of the beam search
+};
+
+// piece indices are the client's: 0 I, 1 J, 2 L, 3 O, 4 S, 5 T, 6 Z
+struct EngineRequest {
+	uint16_t rows[ENGINE_HEIGHT];	// bit x of rows[y] is cell (x, y), row 0 at the bottom
+	int piece;	// piece to place
+	int preview[ENGINE_MAX_PREVIEW];	// pieces after it, in order
+	int numPreview;
+	// nonzero: every reachable placement, answered with a path; zero:
+	// turn-shift-drops only, answered with moveInstr
+	int paths;
+	// version 2
+	// seconds the decision may take: the deepest search finished by then
+	// gives the move, or a Monte Carlo search runs until then; 0 for no
+	// limit
+	double budget;
+};
+
+struct EngineMove {
+	int status;
+	int rot;	// where the piece locks: rotation index and pivot cell
+	int pivotX;
+	int pivotY;
+	int moveInstr;	// turn-shift-drop code of an 'A' reply, 0 for paths
+	int score;
+	int64_t candidates;	// placements scored
+	int pathLength;	// inputs from spawn, then drop; 0 without paths
+	uint8_t path[ENGINE_MAX_PATH];
+};
+
+typedef struct Engine Engine;
+
+int engineApiVersion(void);
+// null if the weights cannot be read
+Engine* createEngine(const struct EngineConfig* config);
+void destroyEngine(Engine* engine);
+// replaces the weights and clears the table; weights the file leaves out
+// take the compiled-in defaults
+// not thread-safe: no engineDecide or engineDecideBatch on this engine may
+// overlap it, the caller has to wait for them
+int engineLoadWeights(Engine* engine, const char* weightsFile);
+// one decision, its subtrees spread over the engine's threads
+// returns move->status
+int engineDecide(Engine* engine, const struct EngineRequest* request, struct EngineMove* move);
+// count decisions at once, spread over the engine's threads a slice at a
+// time; moves[i] answers requests[i]
+// returns the number of moves with status ENGINE_OK
+int engineDecideBatch(Engine* engine, const struct EngineRequest* requests, struct EngineMove* moves, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
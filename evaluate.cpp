@@ -0,0 +1,275 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <immintrin.h>
+
+#include "evaluate.h"
+
+using namespace std;
+
+const Weights defaultWeights = {HEIGHT_WEIGHT, FLAT_WEIGHT, HOLE_WEIGHT, LINE_WEIGHT, DEATH_WEIGHT, PIT_WEIGHT};
+
+// weight names in file order, matched to their Weights fields
+static const char* weightNames[6] = {"height", "flat", "hole", "line", "death", "pit"};
+
+static int* weightField(Weights& weights, int index) {
+	int* fields[6] = {&weights.height, &weights.flat, &weights.hole, &weights.line, &weights.death, &weights.pit};
+	return fields[index];
+}
+
+bool loadWeights(const char* path, Weights& weights) {
+	/*
+		Reads a weights file.
+		Parameters:
+			path (const char*): file to read
+			weights (Weights): updated with every weight the file sets;
+				left alone if the file is bad
+	*/
+	ifstream file(path);
+	if (!file) {
+		cout << "cannot open weights file " << path << endl;
+		return false;
+	}
+	Weights loaded = weights;
+	string line;
+	int lineNum = 0;
+	while (getline(file, line)) {
+		lineNum++;
+		line = line.substr(0, line.find('#'));
+		istringstream fields(line);
+		string name;
+		int value;
+		if (!(fields >> name)) {
+			continue;
+		}
+		int index = 0;
+		while (index < 6 && name != weightNames[index]) {
+			index++;
+		}
+		if (index == 6 || !(fields >> value)) {
+			cout << path << ":" << lineNum << ": expected <weight name> <integer>" << endl;
+			return false;
+		}
+		*weightField(loaded, index) = value;
+	}
+	// the height penalty is a loop power and the line bonus a base
+	if (loaded.height < 0 || loaded.line < 0) {
+		cout << path << ": height and line must not be negative" << endl;
+		return false;
+	}
+	weights = loaded;
+	return true;
+}
+
+bool saveWeights(const char* path, const Weights& weights) {
+	ofstream file(path);
+	Weights copy = weights;
+	for (int i = 0; i < 6; ++i) {
+		file << weightNames[i] << " " << *weightField(copy, i) << endl;
+	}
+	return (bool) file;
+}
+
+// maxHeight^weights.height in integers, shared by both evaluators
+static inline int heightPower(int maxHeight, const Weights& weights) {
+	int result = 1;
+	for (int i = 0; i < weights.height; ++i) {
+		result *= maxHeight;
+	}
+	return result;
+}
+
+// score added for clearing lines
+int lineScore(int numClear, const Weights& weights) {
+	int result = 1;
+	for (int i = 0; i < numClear; ++i) {
+		result *= weights.line;
+	}
+	return result;
+}
+
+int boardScore(const Bitboard& board, const Weights& weights) {
+	/*
+		Scores the shape of a board: taller, bumpier and holier stacks
+		score lower.
+		Parameters:
+			board (Bitboard): board after the piece locked and lines cleared
+			weights (Weights): evaluation weights
+	*/
+	int score = 0;
+	int maxHeight = 0;
+	int deviation = 0;
+	int heights[10] = {0};
+	int numHoles = 0;
+	int numPits = 0;
+	// max height, bumpiness & holes check, one row at a time from the top
+	// covered: columns with a tile somewhere above the current row
+	uint16_t covered = 0;
+	for (int j = BOARD_HEIGHT - 1; j >= 0; j--) {
+		uint16_t row = board.rows[j];
+		// empty cells under a covered column are holes
+		numHoles += __builtin_popcount(~row & covered);
+		// store height of each column the first time it is seen
+		uint16_t fresh = row & ~covered;
+		while (fresh) {
+			heights[__builtin_ctz(fresh)] = j;
+			fresh &= fresh - 1;
+		}
+		covered |= row;
+	}
+	// find max height
+	for (int i = 0; i < 10; i ++) {
+		if (maxHeight < heights[i]) {
+			maxHeight = heights[i];
+		}
+	}
+	// score height; polynomial
+	score -= heightPower(maxHeight, weights)*3;
+	if (maxHeight > 18) {
+		score -= weights.death;
+	}
+	// do SD
+	maxHeight = 0;
+	for (int i = 0; i < 10; i ++) {
+		maxHeight += heights[i];
+	}
+	if (maxHeight%10 < 5){
+		maxHeight = maxHeight/10;
+	} else {
+		maxHeight = 1 + maxHeight/10;
+	}
+	for (int i = 0; i < 10; i ++) {
+		deviation += abs(maxHeight - heights[i]);
+	}
+	// flatness score; linear
+	score -= deviation*weights.flat;
+	score -= numHoles*weights.hole;
+	//pits
+	for (int j = 0; j < maxHeight; j++) {
+		numPits += __builtin_popcount(~board.rows[j] & FULL_ROW);
+	}
+	score -= numPits*weights.pit;
+	return score;
+}
+
+int evaluateBoard(const Bitboard& board, int numClear, const Weights& weights) {
+	return boardScore(board, weights) + lineScore(numClear, weights);
+}
+
+// boards scored per AVX2 pass: one board per 16-bit lane
+#define LANES 16
+
+// boardScore from the features in one batch slot
+static int scoreSlot(const FeatureBatch& batch, int slot, const Weights& weights) {
+	int score = 0;
+	int maxHeight = 0;
+	int sum = 0;
+	int deviation = 0;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		if (maxHeight < batch.heights[i][slot]) {
+			maxHeight = batch.heights[i][slot];
+		}
+		sum += batch.heights[i][slot];
+	}
+	score -= heightPower(maxHeight, weights)*3;
+	if (maxHeight > 18) {
+		score -= weights.death;
+	}
+	int mean = (sum + 5) / 10;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		deviation += abs(mean - batch.heights[i][slot]);
+	}
+	score -= deviation*weights.flat;
+	score -= batch.holes[slot]*weights.hole;
+	score -= batch.pits[slot]*weights.pit;
+	return score;
+}
+
+static void scoreFeaturesScalar(const FeatureBatch& batch, int count, const Weights& weights, int* scores) {
+	for (int i = 0; i < count; ++i) {
+		scores[i] = scoreSlot(batch, i, weights);
+	}
+}
+
+// weighted sum of 8 boards' features, widened from 16 to 32 bits
+__attribute__((target("avx2")))
+static inline __m256i weighFeatures(__m128i maxHeight, __m128i deviation, __m128i holes, __m128i pits, __m128i death,
+		const Weights& weights) {
+	__m256i height32 = _mm256_cvtepi16_epi32(maxHeight);
+	__m256i power = _mm256_set1_epi32(1);
+	for (int i = 0; i < weights.height; ++i) {
+		power = _mm256_mullo_epi32(power, height32);
+	}
+	__m256i score = _mm256_mullo_epi32(power, _mm256_set1_epi32(-3));
+	score = _mm256_add_epi32(score, _mm256_and_si256(_mm256_cvtepi16_epi32(death), _mm256_set1_epi32(-weights.death)));
+	score = _mm256_sub_epi32(score, _mm256_mullo_epi32(_mm256_cvtepi16_epi32(deviation), _mm256_set1_epi32(weights.flat)));
+	score = _mm256_sub_epi32(score, _mm256_mullo_epi32(_mm256_cvtepi16_epi32(holes), _mm256_set1_epi32(weights.hole)));
+	score = _mm256_sub_epi32(score, _mm256_mullo_epi32(_mm256_cvtepi16_epi32(pits), _mm256_set1_epi32(weights.pit)));
+	return score;
+}
+
+__attribute__((target("avx2")))
+static void scoreFeaturesAvx2(const FeatureBatch& batch, int count, const Weights& weights, int* scores) {
+	/*
+		Same arithmetic as scoreSlot for 16 boards per pass, one board in
+		each 16-bit lane. Every feature fits in 16 bits; the weighted sum
+		is done in 32-bit lanes.
+	*/
+	int done = 0;
+	for (; done + LANES <= count; done += LANES) {
+		__m256i heights[BOARD_WIDTH];
+		__m256i maxHeight = _mm256_setzero_si256();
+		__m256i sum = _mm256_setzero_si256();
+		__m256i deviation = _mm256_setzero_si256();
+		for (int i = 0; i < BOARD_WIDTH; ++i) {
+			heights[i] = _mm256_loadu_si256((const __m256i*) (batch.heights[i] + done));
+			maxHeight = _mm256_max_epi16(maxHeight, heights[i]);
+			sum = _mm256_add_epi16(sum, heights[i]);
+		}
+		// rounded mean: (sum + 5) / 10, exact for sums this small
+		__m256i mean = _mm256_mulhi_epu16(_mm256_add_epi16(sum, _mm256_set1_epi16(5)), _mm256_set1_epi16(6554));
+		for (int i = 0; i < BOARD_WIDTH; ++i) {
+			deviation = _mm256_add_epi16(deviation, _mm256_abs_epi16(_mm256_sub_epi16(mean, heights[i])));
+		}
+		__m256i holes = _mm256_loadu_si256((const __m256i*) (batch.holes + done));
+		__m256i pits = _mm256_loadu_si256((const __m256i*) (batch.pits + done));
+		__m256i death = _mm256_cmpgt_epi16(maxHeight, _mm256_set1_epi16(18));
+		// weighted sum in two halves of 8 lanes
+		_mm256_storeu_si256((__m256i*) (scores + done), weighFeatures(_mm256_extracti128_si256(maxHeight, 0),
+				_mm256_extracti128_si256(deviation, 0), _mm256_extracti128_si256(holes, 0),
+				_mm256_extracti128_si256(pits, 0), _mm256_extracti128_si256(death, 0), weights));
+		_mm256_storeu_si256((__m256i*) (scores + done + 8), weighFeatures(_mm256_extracti128_si256(maxHeight, 1),
+				_mm256_extracti128_si256(deviation, 1), _mm256_extracti128_si256(holes, 1),
+				_mm256_extracti128_si256(pits, 1), _mm256_extracti128_si256(death, 1), weights));
+	}
+	// leftover boards; clear the upper halves first, otherwise the SSE code
+	// after this function pays the AVX transition penalty
+	_mm256_zeroupper();
+	for (; done < count; ++done) {
+		scores[done] = scoreSlot(batch, done, weights);
+	}
+}
+
+typedef void (*BatchScorer)(const FeatureBatch&, int, const Weights&, int*);
+
+// picks the evaluator once, on first use
+static BatchScorer pickScorer() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return scoreFeaturesAvx2;
+	}
+	return scoreFeaturesScalar;
+}
+
+static BatchScorer batchScorer = pickScorer();
+
+void scoreFeatures(const FeatureBatch& batch, int count, const Weights& weights, int* scores) {
+	batchScorer(batch, count, weights, scores);
+}
+
+const char* evaluatorName() {
+	return batchScorer == scoreFeaturesAvx2 ? "avx2" : "scalar";
+}
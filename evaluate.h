@@ -0,0 +1,80 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "bitboard.h"
+#include "trackedBoard.h"
+
+// default weighting constants; a weights file overrides them at runtime
+#define HEIGHT_WEIGHT 2	// polynomial
+#define FLAT_WEIGHT 100	 // standard deviation formula
+#define HOLE_WEIGHT 500 // constant
+#define LINE_WEIGHT 15 //
+#define DEATH_WEIGHT 10000
+#define TETRIS_WEIGHT 10000
+#define PIT_WEIGHT 100
+
+// evaluation weights used by a search
+// search values depend on them, so a transposition table filled under one
+// set of weights must be cleared before searching with another
+struct Weights {
+	int height;	// exponent of the max height penalty
+	int flat;	// per unit of deviation from the mean height
+	int hole;	// per empty cell under a column's top
+	int line;	// base of the line clear bonus
+	int death;	// penalty for a stack above row 18
+	int pit;	// per empty cell below the mean height
+};
+
+// the #define weights above
+extern const Weights defaultWeights;
+
+// reads "name value" lines (height, flat, hole, line, death, pit; '#'
+// starts a comment) over the values already in weights
+// returns false and prints the reason if the file is unreadable or bad
+bool loadWeights(const char* path, Weights& weights);
+bool saveWeights(const char* path, const Weights& weights);
+
+// score added for clearing numClear lines
+int lineScore(int numClear, const Weights& weights = defaultWeights);
+
+// score of the shape of a board: taller, bumpier and holier stacks
+// score lower
+int boardScore(const Bitboard& board, const Weights& weights = defaultWeights);
+
+// heuristic score of a board after a lock that cleared numClear lines
+int evaluateBoard(const Bitboard& board, int numClear, const Weights& weights = defaultWeights);
+
+// evaluator inputs for up to BATCH_SIZE boards, one array per feature so
+// the AVX2 scorer loads 16 boards' worth of a feature at once
+#define BATCH_SIZE 64
+struct FeatureBatch {
+	int16_t heights[BOARD_WIDTH][BATCH_SIZE];
+	int16_t holes[BATCH_SIZE];
+	int16_t pits[BATCH_SIZE];
+};
+
+// copies the features of a tracked board into a batch slot
+// O(columns + rows under the mean) instead of a scan of the whole board
+inline void extractFeatures(const TrackedBoard& tracked, FeatureBatch& batch, int slot) {
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		batch.heights[i][slot] = columnHeight(tracked.tops[i]);
+	}
+	batch.holes[slot] = tracked.holes;
+	// pits: empty cells below the rounded mean height
+	int mean = (tracked.sumHeights + 5) / 10;
+	int pits = 0;
+	for (int j = 0; j < mean; ++j) {
+		pits += BOARD_WIDTH - tracked.rowFill[j];
+	}
+	batch.pits[slot] = pits;
+}
+
+// boardScore of the first count slots of a batch, scores[i] for slot i
+// uses AVX2 when the CPU has it and scalar code otherwise; both give
+// exactly the same scores
+void scoreFeatures(const FeatureBatch& batch, int count, const Weights& weights, int* scores);
+
+// name of the evaluator scoreFeatures picked on this CPU
+const char* evaluatorName();
+
+#endif
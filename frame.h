@@ -0,0 +1,170 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+// binary message framing, shared by the client and the server
+// a frame is: magic, version, type, payload length, payload, CRC-16 (big
+// endian, over version..payload). Both ends read one line at a time, so
+// on the wire every '\n', '\r', 0 and escape byte inside the frame is sent
+// as FRAME_ESCAPE followed by the byte xor 0x20, and the frame ends with
+// an unescaped '\n'.
+// types reuse the ASCII message letters:
+//	'I' board, PACKED_BOARD bytes: cell i = (i%10, i/10) is bit i%8 of byte i/8
+//	'C' current piece, PACKED_PIECE bytes: x, y of each tile, then the
+//		rotation index
+//	'R' preview queue, one byte per upcoming piece
+//	'A' reply, empty, or one signed byte of moveInstr after an 'R'
+//	'X' game over, empty
+// version 2 adds server-owned board sync: instead of 'C' and 'R' the
+// client reports every lock and spawn, and the server only hears about
+// the whole board again when the two copies disagree
+//	'L' lock event: tile count (0 or 4), x, y of each locked tile, the piece
+//		that spawned, the boardChecksum of the client's board after the
+//		lock (2 bytes, big endian), then the preview queue
+//	'S' reply to an 'L' whose checksum does not match the server's board:
+//		the client sends 'I' and the 'L' again, without tiles
+// version 3 adds input paths, so the server can use placements a single
+// turn-shift-drop cannot reach
+//	'P' reply to an 'L' instead of 'A': one PATH_* input per byte, played in
+//		order from spawn; the client then drops and locks the piece
+// version 4 tells the server how fast the game is, so it can answer before
+// the piece falls to the stack
+//	'L' carries the client's level (linesCleared/10, at most 255) after the
+//		checksum, before the preview queue
+// the client asks for framing with the ASCII line "V <version>"; a server
+// that supports it replies "A <version> <session>" with the highest version
+// both ends know and the client's session ID, an older one never replies
+// and the client keeps using ASCII; "V <version> <session>" asks a
+// multi-session host to rejoin that session
+
+#define FRAME_MAGIC 0xB7	// first byte of every frame, never an ASCII letter
+#define FRAME_VERSION 4	// newest version; every version down to 1 is accepted
+#define FRAME_ESCAPE 0x7D
+#define FRAME_HEADER 4	// magic, version, type, payload length
+#define FRAME_CRC 2
+#define PACKED_BOARD 25	// 200 cells, one bit each
+#define PACKED_PIECE 9	// four tiles and a rotation index
+#define MAX_PAYLOAD PACKED_BOARD
+#define MAX_FRAME (FRAME_HEADER + MAX_PAYLOAD + FRAME_CRC)
+// longest frame on the wire: every byte escaped
+#define MAX_WIRE_FRAME (2*MAX_FRAME)
+
+// inputs in a 'P' path
+#define PATH_LEFT 0
+#define PATH_RIGHT 1
+#define PATH_CW 2	// turn clockwise with SRS kicks
+#define PATH_CCW 3
+#define PATH_DROP 4	// fall until the piece rests on something
+
+// CRC-16/CCITT-FALSE, bit by bit: frames are short and the client has no
+// room to spare for a table
+inline uint16_t frameCrc(const uint8_t* data, int length) {
+	uint16_t crc = 0xFFFF;
+	for (int i = 0; i < length; ++i) {
+		crc ^= (uint16_t) data[i] << 8;
+		for (int j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+inline bool needsEscape(uint8_t byte) {
+	return byte == '\n' || byte == '\r' || byte == 0 || byte == FRAME_ESCAPE;
+}
+
+inline int encodeFrame(int version, char type, const uint8_t* payload, int length, uint8_t* out) {
+	/*
+		Builds an escaped frame, without the trailing '\n'.
+		Parameters:
+			version (int): version agreed with the other end
+			type (char): message letter
+			payload (uint8_t*): message body
+			length (int): payload bytes, at most MAX_PAYLOAD
+			out (uint8_t*): room for MAX_WIRE_FRAME bytes
+		Returns the number of bytes written.
+	*/
+	uint8_t frame[MAX_FRAME];
+	int size = 0;
+	frame[size++] = FRAME_MAGIC;
+	frame[size++] = version;
+	frame[size++] = type;
+	frame[size++] = length;
+	for (int i = 0; i < length; ++i) {
+		frame[size++] = payload[i];
+	}
+	uint16_t crc = frameCrc(frame + 1, size - 1);
+	frame[size++] = crc >> 8;
+	frame[size++] = crc & 0xFF;
+	int written = 0;
+	for (int i = 0; i < size; ++i) {
+		if (needsEscape(frame[i])) {
+			out[written++] = FRAME_ESCAPE;
+			out[written++] = frame[i] ^ 0x20;
+		} else {
+			out[written++] = frame[i];
+		}
+	}
+	return written;
+}
+
+inline int decodeFrame(const uint8_t* wire, int wireLength, int& version, char& type, uint8_t* payload) {
+	/*
+		Unescapes and checks a frame read off the wire.
+		Parameters:
+			wire (uint8_t*): bytes before the '\n'
+			wireLength (int): number of bytes
+			version (int&): out, version the frame was sent with
+			type (char&): out, message letter
+			payload (uint8_t*): out, room for MAX_PAYLOAD bytes
+		Returns the payload length, or -1 if the frame is damaged or of an
+		unknown version.
+	*/
+	uint8_t frame[MAX_FRAME];
+	int size = 0;
+	for (int i = 0; i < wireLength; ++i) {
+		if (size == MAX_FRAME) {
+			return -1;
+		}
+		if (wire[i] == FRAME_ESCAPE && i + 1 < wireLength) {
+			frame[size++] = wire[++i] ^ 0x20;
+		} else {
+			frame[size++] = wire[i];
+		}
+	}
+	if (size < FRAME_HEADER + FRAME_CRC || frame[0] != FRAME_MAGIC
+			|| frame[1] < 1 || frame[1] > FRAME_VERSION) {
+		return -1;
+	}
+	int length = frame[3];
+	if (length > MAX_PAYLOAD || size != FRAME_HEADER + length + FRAME_CRC) {
+		return -1;
+	}
+	uint16_t crc = frameCrc(frame + 1, FRAME_HEADER - 1 + length);
+	if (frame[size - 2] != (crc >> 8) || frame[size - 1] != (crc & 0xFF)) {
+		return -1;
+	}
+	version = frame[1];
+	type = frame[2];
+	for (int i = 0; i < length; ++i) {
+		payload[i] = frame[FRAME_HEADER + i];
+	}
+	return length;
+}
+
+// cell index (x + 10*y) in a packed board
+inline bool packedCell(const uint8_t* packed, int index) {
+	return (packed[index >> 3] >> (index & 7)) & 1;
+}
+
+inline void setPackedCell(uint8_t* packed, int index) {
+	packed[index >> 3] |= 1 << (index & 7);
+}
+
+// board checksum carried by 'L' events: the CRC of the packed locked tiles
+inline uint16_t boardChecksum(const uint8_t* packed) {
+	return frameCrc(packed, PACKED_BOARD);
+}
+
+#endif
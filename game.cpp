@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "game.h"
+
+using namespace std;
+
+// share of the piece's fall to the stack a decision may use: the rest is
+// the reply's trip over the serial line and the client playing it
+#define DEADLINE_SHARE 0.25
+// shortest deadline; the one piece search never reads the clock, so even
+// this leaves a move
+#define MIN_DEADLINE 0.001
+
+void resetGame(GameState& game) {
+	game.pieceNum = -1;
+	game.numPreview = 0;
+	clearBoard(game.tiles);
+	game.moveInstr = 0;
+	game.currentRotIndex = 0;
+	game.lastResult = SearchResult();
+}
+
+// checks if the active piece can move in a given direction
+// intput: (int) directionX, directionY: offset to test
+// output: boolean return
+bool canMove(const GameState& game, int directionX, int directionY) {
+	return !collides(game.tiles, makeMask(game.currentPiece), directionX, directionY);
+}
+
+// moves the active piece by the given offset
+// no checks, void return
+void shiftPiece(GameState& game, int directionX, int directionY) {
+	for (int i = 0; i < 4; i ++) {
+		game.currentPiece[i][0] += directionX;
+		game.currentPiece[i][1] += directionY;
+	}
+}
+
+// drops the active piece onto the stack
+// void return
+void dropPiece(GameState& game) {
+	shiftPiece(game, 0, -dropDistance(game.tiles, makeMask(game.currentPiece), 0));
+}
+
+// writes the tiles of the active piece from the rotation tables
+// input: pivot position & rotation index, void return
+void placePiece(GameState& game, int pivotX, int pivotY, int rot) {
+	for (int i = 0; i < 4; ++i) {
+		game.currentPiece[i][0] = pivotX + pieceCells[game.pieceNum][rot][i][0];
+		game.currentPiece[i][1] = pivotY + pieceCells[game.pieceNum][rot][i][1];
+	}
+}
+
+void attemptRotation(GameState& game, int clockwise) {
+	/*
+		Attempts to rotate the active piece; a table lookup plus one
+		collision test per kick.
+		Parameters:
+			clockwise (int): Indicates if rotation is CW or CCW [1 for CW, -1 for CCW]
+	*/
+	int pivotX = game.currentPiece[0][0];
+	int pivotY = game.currentPiece[0][1];
+	if (tryRotate(game.tiles, game.pieceNum, game.currentRotIndex, pivotX, pivotY, clockwise)) {
+		placePiece(game, pivotX, pivotY, game.currentRotIndex);
+	}
+}
+
+// locks current piece to the real grid and clears lines
+// no inputs, returns the number of cleared lines
+int lockRealPiece(GameState& game) {
+	PieceMask mask = makeMask(game.currentPiece);
+	lockMask(game.tiles, mask, 0, 0);
+	return clearLines(game.tiles, mask.y, mask.y + mask.height);
+}
+
+// tiles packed into a 4x4 grid from their lowest x and y, bit 4*y + x;
+// 0 if they do not fit one
+static int shapeBits(const int cells[4][2]) {
+	int minX = cells[0][0], minY = cells[0][1];
+	for (int i = 1; i < 4; ++i) {
+		minX = min(minX, cells[i][0]);
+		minY = min(minY, cells[i][1]);
+	}
+	int bits = 0;
+	for (int i = 0; i < 4; ++i) {
+		int x = cells[i][0] - minX;
+		int y = cells[i][1] - minY;
+		if (x > 3 || y > 3) {
+			return 0;
+		}
+		bits |= 1 << (4*y + x);
+	}
+	return bits;
+}
+
+bool validPiece(const GameState& game, const int cells[4][2], int rot) {
+	/*
+		Checks tiles a client sent before they touch the board: makeMask
+		and lockMask index rows by them without any checks.
+		Parameters:
+			game (GameState): board the tiles go on
+			cells (int[4][2]): x, y coordinates of each tile
+			rot (int): rotation index the tiles are in, -1 if not known
+	*/
+	if (rot < -1 || rot > 3) {
+		return false;
+	}
+	for (int i = 0; i < 4; ++i) {
+		int x = cells[i][0];
+		int y = cells[i][1];
+		if (x < 0 || x >= BOARD_WIDTH || y < 0 || y >= BOARD_HEIGHT || getCell(game.tiles, x, y)) {
+			return false;
+		}
+	}
+	int bits = shapeBits(cells);
+	for (int piece = 0; piece < 7; ++piece) {
+		for (int r = 0; r < 4; ++r) {
+			int offsets[4][2];
+			for (int i = 0; i < 4; ++i) {
+				offsets[i][0] = pieceCells[piece][r][i][0];
+				offsets[i][1] = pieceCells[piece][r][i][1];
+			}
+			// four distinct tiles: a repeated one leaves fewer bits set
+			if ((rot == -1 || rot == r) && bits != 0 && bits == shapeBits(offsets)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// pieceNum followed by as much of the preview queue as the search uses
+// output: pieces array, returns the number of pieces
+int decisionPieces(const GameState& game, int* pieces) {
+	int plies = 1;
+	pieces[0] = game.pieceNum;
+	for (int i = 0; i < game.numPreview && plies < MAX_PLIES; ++i) {
+		pieces[plies++] = game.preview[i];
+	}
+	return plies;
+}
+
+bool calculateMove(GameState& game, const SearchContext& context) {
+	/*
+		Searches the move for pieceNum, looking ahead through the preview
+		queue, and stores it in moveInstr and lastResult.
+		Parameters:
+			game (GameState): game to move in
+			context (SearchContext): workers, table and weights to search with
+		Returns false if the piece cannot spawn.
+	*/
+	int pieces[MAX_PLIES];
+	int plies = decisionPieces(game, pieces);
+	game.lastResult = searchMove(game.tiles, pieces, plies, context);
+	// no placement means the game is lost; just drop the piece
+	game.moveInstr = game.lastResult.moveInstr;
+	return game.lastResult.found;
+}
+
+int gravityInterval(int level) {
+	if (level < 9) {
+		return (48 - level*5)*100/6;
+	} else if (level < 27) {
+		return (9 - level/3)*100/6;
+	}
+	return 100/6;
+}
+
+double gravityBudget(const Bitboard& tiles, int piece, int level, double cap) {
+	/*
+		Deadline of a decision the client is waiting for. The piece in
+		play keeps falling while the client waits, one row every
+		gravityInterval, and has to be moved before it reaches the stack;
+		the decision gets DEADLINE_SHARE of that time, so the deadline
+		shrinks with the level and with the rows left above the stack.
+		Parameters:
+			tiles (Bitboard): board the piece spawned on
+			piece (int): piece in play
+			level (int): client's level, linesCleared/10
+			cap (double): longest budget in seconds, 0 for none
+	*/
+	int8_t tops[BOARD_WIDTH];
+	int highest = 0;
+	columnTops(tiles, tops);
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		highest = max(highest, (int) tops[i]);
+	}
+	int rows = max(1, spawnPivot[piece >= 0 && piece <= 6 ? piece : 0][1] - 1 - highest);
+	double budget = max(MIN_DEADLINE, DEADLINE_SHARE * rows * gravityInterval(max(level, 0)) / 1000);
+	return cap > 0 ? min(budget, cap) : budget;
+}
+
+// plays moveInstr on the real grid the way the client does
+// returns the number of cleared lines
+int applyMove(GameState& game) {
+	// spawn piece
+	game.currentRotIndex = 0;
+	placePiece(game, spawnPivot[game.pieceNum][0], spawnPivot[game.pieceNum][1], 0);
+	// emulate move
+	for (int i = 0; i < abs(game.moveInstr)%10; i++) {
+		attemptRotation(game, 1);
+	}
+	// shift
+	for (int i = 0; i < abs(game.moveInstr/10); i++) {
+		if (game.moveInstr/10 != 9) {
+			if (game.moveInstr > 0 && canMove(game, 1, 0)) {
+				shiftPiece(game, 1, 0);
+			} else if (canMove(game, -1, 0)){
+				shiftPiece(game, -1, 0);
+			}
+		}
+	}
+	// move down
+	dropPiece(game);
+	return lockRealPiece(game);
+}
@@ -0,0 +1,46 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "bitboard.h"
+#include "search.h"
+
+// the server's copy of one client's game, shared by the serial server, the
+// multi-session host and the headless simulator
+struct GameState {
+	// piece the client plays next; -1 until the first 'R' after a 'C'
+	int pieceNum;
+	// preview queue from the last 'R' message
+	int preview[MAX_PLIES];
+	int numPreview;
+
+	Bitboard tiles;
+	int currentPiece[4][2];
+	// tens = horizontal shift (=-); ones = rotation
+	int moveInstr;
+	int currentRotIndex;
+	// search behind the last calculateMove
+	SearchResult lastResult;
+};
+
+// empty board, no piece
+void resetGame(GameState& game);
+bool canMove(const GameState& game, int directionX, int directionY);
+void shiftPiece(GameState& game, int directionX, int directionY);
+void dropPiece(GameState& game);
+void placePiece(GameState& game, int pivotX, int pivotY, int rot);
+void attemptRotation(GameState& game, int clockwise);
+int lockRealPiece(GameState& game);
+// true if cells are four tiles on the board, clear of the locked ones, in
+// the shape of some piece at rotation rot, or at any rotation if rot is -1
+bool validPiece(const GameState& game, const int cells[4][2], int rot);
+int decisionPieces(const GameState& game, int* pieces);
+bool calculateMove(GameState& game, const SearchContext& context);
+// the client's gravity at a level, as updateScore sets speedUp: milliseconds
+// the piece in play takes to fall one row
+int gravityInterval(int level);
+// seconds a decision about piece, just spawned on tiles, may take at a
+// level's gravity; at most cap unless cap is 0
+double gravityBudget(const Bitboard& tiles, int piece, int level, double cap);
+int applyMove(GameState& game);
+
+#endif
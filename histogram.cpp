@@ -0,0 +1,125 @@
+#include <iomanip>
+
+#include "histogram.h"
+
+using namespace std;
+
+Histogram::Histogram() {
+	reset();
+}
+
+int Histogram::bucketIndex(uint64_t value) {
+	/*
+		Bucket of a value: exact below 2*HIST_SUB_BUCKETS, above that the
+		top HIST_SUB_BITS + 1 bits select one of HIST_SUB_BUCKETS buckets
+		in the value's power of two.
+		Parameters:
+			value (uint64_t): value to place
+	*/
+	if (value < 2 * HIST_SUB_BUCKETS) {
+		return value;
+	}
+	int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return shift * HIST_SUB_BUCKETS + (int) (value >> shift);
+}
+
+// largest value that lands in a bucket
+int64_t Histogram::bucketTop(int index) {
+	if (index < 2 * HIST_SUB_BUCKETS) {
+		return index;
+	}
+	int shift = index / HIST_SUB_BUCKETS - 1;
+	uint64_t sub = index % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS;
+	return (int64_t) (((sub + 1) << shift) - 1);
+}
+
+void Histogram::record(int64_t value) {
+	if (value < 0) {
+		value = 0;
+	}
+	counts[bucketIndex(value)]++;
+	if (total == 0 || value < low) {
+		low = value;
+	}
+	if (total == 0 || value > high) {
+		high = value;
+	}
+	total++;
+	sum += value;
+}
+
+void Histogram::merge(const Histogram& other) {
+	if (other.total == 0) {
+		return;
+	}
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		counts[i] += other.counts[i];
+	}
+	if (total == 0 || other.low < low) {
+		low = other.low;
+	}
+	if (total == 0 || other.high > high) {
+		high = other.high;
+	}
+	total += other.total;
+	sum += other.sum;
+}
+
+void Histogram::reset() {
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		counts[i] = 0;
+	}
+	total = 0;
+	sum = 0;
+	low = 0;
+	high = 0;
+}
+
+long Histogram::count() const {
+	return total;
+}
+
+int64_t Histogram::min() const {
+	return low;
+}
+
+int64_t Histogram::max() const {
+	return high;
+}
+
+double Histogram::mean() const {
+	return total > 0 ? sum / total : 0;
+}
+
+int64_t Histogram::percentile(double fraction) const {
+	if (total == 0) {
+		return 0;
+	}
+	// rank of the wanted record, counting from 1
+	long rank = (long) (fraction * total + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	long seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		seen += counts[i];
+		if (seen >= rank) {
+			// the bucket's top, but never past what was actually recorded
+			int64_t top = bucketTop(i);
+			return top < high ? top : high;
+		}
+	}
+	return high;
+}
+
+void Histogram::print(ostream& out, const char* name, const char* unit) const {
+	out << left << setw(12) << name << right
+		<< " n " << setw(7) << total
+		<< "  mean " << setw(8) << fixed << setprecision(0) << mean()
+		<< "  p50 " << setw(8) << percentile(0.5)
+		<< "  p90 " << setw(8) << percentile(0.9)
+		<< "  p99 " << setw(8) << percentile(0.99)
+		<< "  p999 " << setw(8) << percentile(0.999)
+		<< "  max " << setw(8) << high << " " << unit << endl;
+	out.unsetf(ios::fixed);
+}
@@ -0,0 +1,49 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <ostream>
+
+// precision of the histogram: every power of two is split into 2^HIST_SUB_BITS
+// linear buckets, so a recorded value is kept to within 1/32 (about 3%)
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+// values below 2*HIST_SUB_BUCKETS get a bucket each; the last power of two
+// ends at 2^63
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS) * HIST_SUB_BUCKETS)
+
+// latency histogram in the style of HdrHistogram: fixed memory, constant
+// time record, and any percentile read back to the bucket precision
+// values are plain integers, the caller picks the unit (microseconds for
+// every timer in this project)
+class Histogram {
+public:
+	Histogram();
+
+	void record(int64_t value);
+	void merge(const Histogram& other);
+	void reset();
+
+	long count() const;
+	int64_t min() const;
+	int64_t max() const;
+	double mean() const;
+	// smallest value at least fraction of the records are at or below
+	// (fraction 0.5 for p50, 0.999 for p999), 0 if empty
+	int64_t percentile(double fraction) const;
+
+	// one line: count, mean, p50, p90, p99, p999 and max
+	void print(std::ostream& out, const char* name, const char* unit) const;
+
+private:
+	static int bucketIndex(uint64_t value);
+	static int64_t bucketTop(int index);
+
+	long counts[HIST_BUCKETS];
+	long total;
+	double sum;
+	int64_t low;
+	int64_t high;
+};
+
+#endif
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "logger.h"
+#include "session.h"
+#include "threadPool.h"
+#include "transposition.h"
+
+using namespace std;
+
+// one table for every session: 2^22 slots of 16 bytes
+#define HOST_TABLE_BITS 22
+#define DEFAULT_SOCKET "/tmp/tetrisAI.sock"
+// longest line kept while waiting for its newline; a board line is 202
+// bytes and the longest frame MAX_WIRE_FRAME
+#define MAX_LINE 1024
+// reply bytes kept for a client that is not reading; past this it is
+// dropped rather than buffered without end
+#define MAX_OUTBOX (64*1024)
+// sessions kept for "V <version> <session>" after their connection closes
+#define MAX_DETACHED 64
+#define LISTEN_BACKLOG 64
+
+// a session plus the host's bookkeeping around it
+struct HostSession {
+	Session session;
+	int fd;	// connection it is attached to, -1 once detached
+	vector<string> lines;	// complete lines not handled yet
+	// a pool task owns the session until the wake pipe says it is done
+	bool deciding;
+	bool used;	// has handled a message besides the handshake, so its game is worth keeping
+	Message message;	// message being decided
+	MessageAction action;
+	int64_t received;	// when message was read, in microseconds
+	int64_t decideMicros;	// set by the task
+	long detachedAt;	// detach order, oldest evicted first
+	TaskGroup group;
+};
+
+// a socket or pty the host reads messages from
+struct Connection {
+	int fd;
+	int slave;	// pty slave kept open so the master never reads EIO, -1 for sockets
+	string name;
+	string inbox;	// bytes after the last complete line
+	string outbox;	// reply bytes the connection has not taken yet
+	bool failed;	// a write failed or the outbox overflowed: closed by the poll loop
+	int sessionId;
+};
+
+ThreadPool* pool = 0;
+SearchContext sharedContext = {0, 0, 0, 0, false, false, 0, 0, 0, false};
+map<int, HostSession*> sessions;
+map<int, Connection> connections;
+int nextSessionId = 1;
+long detachCount = 0;
+
+// tasks report finished sessions here and write a byte to the wake pipe
+mutex finishedLock;
+vector<int> finished;
+int wakePipe[2] = {-1, -1};
+
+Histogram decideTimes;	// search and path, on a pool thread
+Histogram serviceTimes;	// line read to reply written, queueing included
+long messageCount = 0;
+volatile sig_atomic_t statsRequested = 0;
+volatile sig_atomic_t stopping = 0;
+
+void requestStats(int) {
+	statsRequested = 1;
+}
+
+void requestStop(int) {
+	stopping = 1;
+}
+
+static int64_t nowMicros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void printStats() {
+	ostringstream text;
+	decideTimes.print(text, "decide", "us");
+	serviceTimes.print(text, "service", "us");
+	LOG(LOG_INFO, "%zu sessions, %zu connections, %ld messages", sessions.size(), connections.size(), messageCount);
+	istringstream lines(text.str());
+	string line;
+	while (getline(lines, line)) {
+		LOG(LOG_INFO, "%s", line.c_str());
+	}
+}
+
+HostSession* newSession() {
+	HostSession* host = new HostSession();
+	initSession(host->session, nextSessionId++, sharedContext);
+	host->fd = -1;
+	host->deciding = false;
+	host->used = false;
+	host->detachedAt = 0;
+	sessions[host->session.id] = host;
+	return host;
+}
+
+// frees the session that has been detached longest once there are too many
+void evictDetached() {
+	HostSession* oldest = 0;
+	int detached = 0;
+	for (map<int, HostSession*>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		HostSession* host = it->second;
+		if (host->fd < 0 && !host->deciding) {
+			detached++;
+			if (!oldest || host->detachedAt < oldest->detachedAt) {
+				oldest = host;
+			}
+		}
+	}
+	if (detached > MAX_DETACHED) {
+		LOG(LOG_INFO, "session %d: dropped", oldest->session.id);
+		sessions.erase(oldest->session.id);
+		delete oldest;
+	}
+}
+
+void detach(HostSession* host) {
+	host->fd = -1;
+	host->lines.clear();
+	host->detachedAt = ++detachCount;
+	evictDetached();
+}
+
+void addConnection(int fd, int slave, const string& name) {
+	HostSession* host = newSession();
+	host->fd = fd;
+	// the poll loop is the only thread that touches connections: a client
+	// that stops reading must not block it
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	Connection connection = {fd, slave, name, "", "", false, host->session.id};
+	connections[fd] = connection;
+	LOG(LOG_INFO, "session %d: %s connected", host->session.id, name.c_str());
+}
+
+void closeConnection(int fd) {
+	Connection& connection = connections[fd];
+	LOG(LOG_INFO, "session %d: %s closed", connection.sessionId, connection.name.c_str());
+	map<int, HostSession*>::iterator it = sessions.find(connection.sessionId);
+	if (it != sessions.end()) {
+		detach(it->second);
+	}
+	close(fd);
+	if (connection.slave >= 0) {
+		close(connection.slave);
+	}
+	connections.erase(fd);
+}
+
+// writes as much of the outbox as the connection takes without blocking
+void flushConnection(Connection& connection) {
+	while (!connection.outbox.empty() && !connection.failed) {
+		ssize_t count = write(connection.fd, connection.outbox.data(), connection.outbox.size());
+		if (count > 0) {
+			connection.outbox.erase(0, count);
+		} else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		} else if (count < 0 && errno != EINTR) {
+			LOG(LOG_WARN, "session %d: write failed", connection.sessionId);
+			connection.failed = true;
+		}
+	}
+}
+
+// queues bytes for the connection and sends what it takes now; the rest
+// goes out when poll says it is writable
+void queueOutput(Connection& connection, const string& bytes) {
+	if (connection.failed) {
+		return;
+	}
+	if (connection.outbox.size() + bytes.size() > MAX_OUTBOX) {
+		LOG(LOG_WARN, "session %d: %s is not reading, dropped", connection.sessionId, connection.name.c_str());
+		connection.outbox.clear();
+		connection.failed = true;
+		return;
+	}
+	connection.outbox += bytes;
+	flushConnection(connection);
+}
+
+void sendReply(HostSession* host, const Message& message, MessageAction action, bool decided) {
+	/*
+		Writes the reply to the session's connection, if it still has one,
+		and moves the game past it.
+		Parameters:
+			host (HostSession): session that was answered
+			message, action: the message and what readMessage made of it
+			decided (bool): a search ran for the reply
+	*/
+	Session& session = host->session;
+	string reply = encodeReply(session, message, action);
+	if (host->fd >= 0 && !reply.empty()) {
+		queueOutput(connections[host->fd], reply);
+	}
+	serviceTimes.record(nowMicros() - host->received);
+	logReply(session, message, action, decided, false);
+	finishMessage(session, message);
+}
+
+// the search task: runs on a pool thread, touches nothing but its session
+void decide(HostSession* host) {
+	int64_t start = nowMicros();
+	decideSession(host->session);
+	host->decideMicros = nowMicros() - start;
+	{
+		lock_guard<mutex> guard(finishedLock);
+		finished.push_back(host->session.id);
+	}
+	char byte = 0;
+	if (write(wakePipe[1], &byte, 1) < 0) {
+		// the pipe is full, so the poll loop is waking up anyway
+	}
+}
+
+// switches the connection to an earlier session, "V <version> <session>"
+void resume(Connection& connection, HostSession*& host, int resumeId) {
+	map<int, HostSession*>::iterator it = sessions.find(resumeId);
+	if (it == sessions.end() || it->second->fd >= 0 || it->second->deciding) {
+		LOG(LOG_WARN, "session %d: cannot resume session %d", host->session.id, resumeId);
+		return;
+	}
+	HostSession* resumed = it->second;
+	resumed->fd = connection.fd;
+	Message message = host->message;
+	// a session that has seen a board is left to be resumed in turn, one
+	// that has not is only the connection's placeholder
+	if (host->used) {
+		detach(host);
+	} else {
+		sessions.erase(host->session.id);
+		delete host;
+	}
+	host = resumed;
+	connection.sessionId = host->session.id;
+	host->message = message;
+	LOG(LOG_INFO, "session %d: resumed on %s", host->session.id, connection.name.c_str());
+}
+
+void handleLines(HostSession* host) {
+	/*
+		Handles the session's queued lines in order; stops at a line that
+		needs a search, which continues once its task is done.
+		Parameters:
+			host (HostSession): session with new lines or a finished search
+	*/
+	while (!host->deciding && !host->lines.empty()) {
+		string line = host->lines.front();
+		host->lines.erase(host->lines.begin());
+		host->received = nowMicros();
+		Message& message = host->message;
+		MessageAction action = readMessage(host->session, line, message);
+		messageCount++;
+		if (action == ACTION_NONE) {
+			continue;
+		}
+		if (action != ACTION_HANDSHAKE) {
+			host->used = true;
+		}
+		if (action == ACTION_QUIT) {
+			// the game is over, the connection stays for the next one
+			LOG(LOG_INFO, "session %d: game over", host->session.id);
+			resetGame(host->session.game);
+			continue;
+		}
+		if (action == ACTION_HANDSHAKE && message.resumeId >= 0 && message.resumeId != host->session.id) {
+			vector<string> rest = host->lines;
+			resume(connections[host->fd], host, message.resumeId);
+			host->lines = rest;
+			host->received = nowMicros();
+			sendReply(host, host->message, action, false);
+			continue;
+		}
+		if (action == ACTION_MOVE && needsDecision(host->session, message)) {
+			host->deciding = true;
+			host->action = action;
+			pool->submit(host->group, [host]() { decide(host); });
+			return;
+		}
+		sendReply(host, message, action, false);
+	}
+}
+
+// replies to every session whose search has finished
+void collectFinished() {
+	char bytes[64];
+	while (read(wakePipe[0], bytes, sizeof(bytes)) > 0) {
+	}
+	vector<int> done;
+	{
+		lock_guard<mutex> guard(finishedLock);
+		done.swap(finished);
+	}
+	for (size_t i = 0; i < done.size(); ++i) {
+		map<int, HostSession*>::iterator it = sessions.find(done[i]);
+		if (it == sessions.end()) {
+			continue;
+		}
+		HostSession* host = it->second;
+		host->deciding = false;
+		decideTimes.record(host->decideMicros);
+		sendReply(host, host->message, host->action, true);
+		handleLines(host);
+		if (host->fd < 0) {
+			evictDetached();
+		}
+	}
+}
+
+void readConnection(int fd) {
+	/*
+		Reads what the connection has sent and queues its complete lines.
+		Parameters:
+			fd (int): readable connection
+	*/
+	char buffer[4096];
+	ssize_t count = read(fd, buffer, sizeof(buffer));
+	if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return;
+	}
+	if (count <= 0) {
+		closeConnection(fd);
+		return;
+	}
+	Connection& connection = connections[fd];
+	HostSession* host = sessions[connection.sessionId];
+	connection.inbox.append(buffer, count);
+	size_t start = 0;
+	size_t end;
+	while ((end = connection.inbox.find('\n', start)) != string::npos) {
+		// frames escape '\r' and '\n', so trailing ones are line endings
+		size_t length = end - start;
+		while (length > 0 && connection.inbox[start + length - 1] == '\r') {
+			length--;
+		}
+		host->lines.push_back(connection.inbox.substr(start, length));
+		start = end + 1;
+	}
+	connection.inbox.erase(0, start);
+	if (connection.inbox.size() > MAX_LINE) {
+		LOG(LOG_WARN, "session %d: line too long, dropped", host->session.id);
+		connection.inbox.clear();
+	}
+	handleLines(host);
+}
+
+int listenSocket(const char* path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		cout << "socket path too long: " << path << endl;
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+	unlink(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (sockaddr*) &address, sizeof(address)) != 0 || listen(fd, LISTEN_BACKLOG) != 0) {
+		cout << "cannot listen on " << path << endl;
+		return -1;
+	}
+	return fd;
+}
+
+bool openPty() {
+	/*
+		Opens a pseudo-terminal for a serial client: the client (or a
+		bridge such as socat from the real serial port) opens the slave,
+		whose path is logged, and the host reads the master.
+	*/
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		cout << "cannot open a pty" << endl;
+		return false;
+	}
+	string slave = ptsname(master);
+	// raw bytes both ways, like a USB serial line
+	int slaveFd = open(slave.c_str(), O_RDWR | O_NOCTTY);
+	termios mode;
+	tcgetattr(slaveFd, &mode);
+	cfmakeraw(&mode);
+	tcsetattr(slaveFd, TCSANOW, &mode);
+	addConnection(master, slaveFd, slave);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	/*
+		Hosts many games at once: every connection is a session with its
+		own game, and all of them share one worker pool, transposition
+		table and set of weights.
+		Usage: host [-s socket] [-t ptys] [-j threads] [-l logFile] [-L level] [-c cacheFile] [-e chancePlies]
+				[-b budget] [-m] [weightsFile]
+			socket: unix-domain socket to listen on, /tmp/tetrisAI.sock
+				if omitted
+			ptys: pseudo-terminals to open for serial clients, default 0;
+				their paths are logged
+			threads: search threads, 0 for one per core, default 0
+			logFile, level, cacheFile, chancePlies, budget, -m,
+				weightsFile: as for the serial server; the cache is saved
+				when the host stops
+		The handshake reply carries the session ID; "V <version> <session>"
+		on a new connection rejoins a session whose connection closed.
+		kill -USR1 logs the host's timings, SIGINT or SIGTERM stops it.
+	*/
+	const char* socketPath = DEFAULT_SOCKET;
+	const char* weightsFile = 0;
+	const char* logFile = 0;
+	const char* cacheFile = 0;
+	int ptys = 0;
+	int threads = 0;
+	for (int i = 1; i < argc; ++i) {
+		string option = argv[i];
+		if (option == "-s" && i + 1 < argc) {
+			socketPath = argv[++i];
+		} else if (option == "-t" && i + 1 < argc) {
+			ptys = atoi(argv[++i]);
+		} else if (option == "-c" && i + 1 < argc) {
+			cacheFile = argv[++i];
+		} else if (option == "-e" && i + 1 < argc) {
+			sharedContext.chancePlies = atoi(argv[++i]);
+		} else if (option == "-b" && i + 1 < argc) {
+			sharedContext.budget = atof(argv[++i]) / 1000;
+		} else if (option == "-m") {
+			sharedContext.monteCarlo = true;
+		} else if (option == "-j" && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (option == "-l" && i + 1 < argc) {
+			logFile = argv[++i];
+		} else if (option == "-L" && i + 1 < argc) {
+			int level = parseLogLevel(argv[++i]);
+			if (level < 0) {
+				cout << "unknown log level " << argv[i] << endl;
+				return 1;
+			}
+			logLevel = level;
+		} else {
+			weightsFile = argv[i];
+		}
+	}
+	if (!startLogger(logFile)) {
+		return 1;
+	}
+	Weights weights = defaultWeights;
+	if (weightsFile && !loadWeights(weightsFile, weights)) {
+		return 1;
+	}
+	ThreadPool workers(threads);
+	TranspositionTable table(HOST_TABLE_BITS);
+	pool = &workers;
+	sharedContext.pool = &workers;
+	sharedContext.table = &table;
+	sharedContext.weights = &weights;
+	sharedContext.mirrored = true;
+	uint64_t tableKey = tableTag(weights);
+	if (cacheFile) {
+		LOG(LOG_INFO, "cache %s: %s", cacheFile, table.load(cacheFile, tableKey) ? "loaded" : "starting cold");
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGUSR1, requestStats);
+	signal(SIGINT, requestStop);
+	signal(SIGTERM, requestStop);
+
+	int listener = listenSocket(socketPath);
+	if (listener < 0 || pipe(wakePipe) != 0) {
+		return 1;
+	}
+	fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+	for (int i = 0; i < ptys; ++i) {
+		if (!openPty()) {
+			return 1;
+		}
+	}
+	LOG(LOG_INFO, "listening on %s, %d threads", socketPath, workers.size());
+
+	vector<pollfd> ready;
+	while (!stopping) {
+		ready.clear();
+		ready.push_back(pollfd{wakePipe[0], POLLIN, 0});
+		ready.push_back(pollfd{listener, POLLIN, 0});
+		for (map<int, Connection>::iterator it = connections.begin(); it != connections.end(); ++it) {
+			short events = it->second.outbox.empty() ? POLLIN : POLLIN | POLLOUT;
+			ready.push_back(pollfd{it->first, events, 0});
+		}
+		if (poll(ready.data(), ready.size(), -1) < 0) {
+			// interrupted by a signal: stats or stop
+			if (statsRequested) {
+				statsRequested = 0;
+				printStats();
+			}
+			continue;
+		}
+		if (ready[0].revents) {
+			collectFinished();
+		}
+		if (ready[1].revents & POLLIN) {
+			int fd = accept(listener, 0, 0);
+			if (fd >= 0) {
+				addConnection(fd, -1, "socket");
+			}
+		}
+		for (size_t i = 2; i < ready.size(); ++i) {
+			if ((ready[i].revents & POLLOUT) && connections.count(ready[i].fd)) {
+				flushConnection(connections[ready[i].fd]);
+			}
+			if ((ready[i].revents & ~POLLOUT) && connections.count(ready[i].fd)) {
+				readConnection(ready[i].fd);
+			}
+		}
+		vector<int> failed;
+		for (map<int, Connection>::iterator it = connections.begin(); it != connections.end(); ++it) {
+			if (it->second.failed) {
+				failed.push_back(it->first);
+			}
+		}
+		for (size_t i = 0; i < failed.size(); ++i) {
+			closeConnection(failed[i]);
+		}
+	}
+
+	// let the running searches finish before their sessions go away
+	for (map<int, HostSession*>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		workers.wait(it->second->group);
+	}
+	printStats();
+	if (cacheFile && !table.save(cacheFile, tableKey)) {
+		LOG(LOG_WARN, "cannot save cache %s", cacheFile);
+	}
+	while (!connections.empty()) {
+		closeConnection(connections.begin()->first);
+	}
+	for (map<int, HostSession*>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		delete it->second;
+	}
+	close(listener);
+	unlink(socketPath);
+	return 0;
+}
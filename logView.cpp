@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+
+using namespace std;
+
+// prints a board record top row first, like the old printTiles
+void printBoard(const uint16_t* rows) {
+	for (int y = BOARD_HEIGHT - 1; y >= 0; --y) {
+		printf("             ");
+		for (int x = 0; x < BOARD_WIDTH; ++x) {
+			putchar((rows[y] >> x) & 1 ? '#' : '.');
+		}
+		putchar('\n');
+	}
+}
+
+int main(int argc, char* argv[]) {
+	/*
+		Pretty-prints a binary log written by the server's -l option.
+		Usage: logView <logFile> [level]
+			level: lowest level shown (debug, info, warn, error), default
+				debug
+	*/
+	if (argc < 2) {
+		printf("usage: logView <logFile> [level]\n");
+		return 1;
+	}
+	int minLevel = argc > 2 ? parseLogLevel(argv[2]) : LOG_DEBUG;
+	if (minLevel < 0) {
+		printf("unknown level %s\n", argv[2]);
+		return 1;
+	}
+	FILE* file = fopen(argv[1], "rb");
+	char magic[LOG_FILE_MAGIC_SIZE];
+	if (!file || fread(magic, 1, LOG_FILE_MAGIC_SIZE, file) != LOG_FILE_MAGIC_SIZE
+			|| memcmp(magic, LOG_FILE_MAGIC, LOG_FILE_MAGIC_SIZE) != 0) {
+		printf("%s is not a server log\n", argv[1]);
+		return 1;
+	}
+	LogHeader header;
+	char data[LOG_DATA_SIZE];
+	while (fread(&header, sizeof(header), 1, file) == 1) {
+		if (header.length > LOG_DATA_SIZE || fread(data, 1, header.length, file) != header.length) {
+			printf("truncated record\n");
+			return 1;
+		}
+		if (header.level < minLevel) {
+			continue;
+		}
+		printf("[%10.6f] %-5s ", header.micros / 1e6, logLevelName(header.level));
+		if (header.kind == LOG_KIND_TEXT) {
+			printf("%.*s\n", (int) header.length, data);
+		} else if (header.kind == LOG_KIND_BOARD && header.length == BOARD_HEIGHT * sizeof(uint16_t)) {
+			uint16_t rows[BOARD_HEIGHT];
+			memcpy(rows, data, sizeof(rows));
+			printf("board\n");
+			printBoard(rows);
+		} else {
+			printf("unknown record kind %d\n", header.kind);
+		}
+	}
+	fclose(file);
+	return 0;
+}
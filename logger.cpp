@@ -0,0 +1,191 @@
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "logger.h"
+
+using namespace std;
+
+atomic<int> logLevel(LOG_INFO);
+
+// one ring slot; sequence says whose turn it is (Vyukov's bounded queue):
+// pos when free for the producer claiming pos, pos + 1 once that record is
+// written, pos + LOG_RING_SIZE when the writer has taken it
+struct LogSlot {
+	atomic<uint64_t> sequence;
+	LogHeader header;
+	char data[LOG_DATA_SIZE];
+};
+
+static LogSlot ring[LOG_RING_SIZE];
+static atomic<uint64_t> enqueuePos(0);
+static uint64_t dequeuePos = 0;	// writer thread only
+static atomic<long> dropped(0);
+static atomic<bool> running(false);
+static thread writer;
+static FILE* binaryLog = 0;
+static chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+// sequences start out free for the first lap of producers
+static struct RingInit {
+	RingInit() {
+		for (uint64_t i = 0; i < LOG_RING_SIZE; ++i) {
+			ring[i].sequence.store(i, memory_order_relaxed);
+		}
+	}
+} ringInit;
+
+static const char* levelNames[] = {"debug", "info", "warn", "error", "off"};
+
+const char* logLevelName(int level) {
+	return level >= LOG_DEBUG && level <= LOG_OFF ? levelNames[level] : "?";
+}
+
+int parseLogLevel(const char* name) {
+	for (int i = LOG_DEBUG; i <= LOG_OFF; ++i) {
+		if (strcmp(name, levelNames[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+long droppedRecords() {
+	return dropped.load(memory_order_relaxed);
+}
+
+static LogSlot* claimSlot(uint64_t& pos) {
+	/*
+		Reserves the next free slot without locking.
+		Parameters:
+			pos (uint64_t&): out, the slot's position, passed to publish
+		Returns 0 if the ring is full.
+	*/
+	pos = enqueuePos.load(memory_order_relaxed);
+	while (true) {
+		LogSlot& slot = ring[pos & (LOG_RING_SIZE - 1)];
+		int64_t diff = (int64_t) (slot.sequence.load(memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				return &slot;
+			}
+		} else if (diff < 0) {
+			// the writer has not freed this slot yet: the ring is full
+			dropped.fetch_add(1, memory_order_relaxed);
+			return 0;
+		} else {
+			pos = enqueuePos.load(memory_order_relaxed);
+		}
+	}
+}
+
+static void publish(LogSlot* slot, uint64_t pos, int kind, int level, int length) {
+	slot->header.micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count();
+	slot->header.kind = kind;
+	slot->header.level = level;
+	slot->header.length = length;
+	slot->header.reserved = 0;
+	slot->sequence.store(pos + 1, memory_order_release);
+}
+
+void logText(int level, const char* format, ...) {
+	uint64_t pos;
+	LogSlot* slot = claimSlot(pos);
+	if (!slot) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(slot->data, LOG_DATA_SIZE, format, args);
+	va_end(args);
+	if (length < 0) {
+		length = 0;
+	} else if (length >= LOG_DATA_SIZE) {
+		length = LOG_DATA_SIZE - 1;
+	}
+	publish(slot, pos, LOG_KIND_TEXT, level, length);
+}
+
+void logBoard(int level, const Bitboard& board) {
+	uint64_t pos;
+	LogSlot* slot = claimSlot(pos);
+	if (!slot) {
+		return;
+	}
+	memcpy(slot->data, board.rows, sizeof(board.rows));
+	publish(slot, pos, LOG_KIND_BOARD, level, sizeof(board.rows));
+}
+
+// writes out every published record, returns how many there were
+static int drain() {
+	int count = 0;
+	while (true) {
+		LogSlot& slot = ring[dequeuePos & (LOG_RING_SIZE - 1)];
+		if (slot.sequence.load(memory_order_acquire) != dequeuePos + 1) {
+			break;
+		}
+		const LogHeader& header = slot.header;
+		if (header.kind == LOG_KIND_TEXT) {
+			fprintf(stdout, "[%10.6f] %-5s %.*s\n", header.micros / 1e6, logLevelName(header.level),
+				(int) header.length, slot.data);
+		}
+		if (binaryLog) {
+			fwrite(&header, sizeof(header), 1, binaryLog);
+			fwrite(slot.data, 1, header.length, binaryLog);
+		}
+		slot.sequence.store(dequeuePos + LOG_RING_SIZE, memory_order_release);
+		dequeuePos++;
+		count++;
+	}
+	if (count > 0) {
+		fflush(stdout);
+		if (binaryLog) {
+			fflush(binaryLog);
+		}
+	}
+	return count;
+}
+
+static void writerLoop() {
+	while (running.load(memory_order_acquire)) {
+		if (drain() == 0) {
+			this_thread::sleep_for(chrono::milliseconds(LOG_FLUSH_MS));
+		}
+	}
+}
+
+bool startLogger(const char* binaryPath) {
+	if (running.load()) {
+		return true;
+	}
+	if (binaryPath) {
+		binaryLog = fopen(binaryPath, "wb");
+		if (!binaryLog) {
+			fprintf(stderr, "cannot create log file %s\n", binaryPath);
+			return false;
+		}
+		fwrite(LOG_FILE_MAGIC, 1, LOG_FILE_MAGIC_SIZE, binaryLog);
+	}
+	running.store(true);
+	writer = thread(writerLoop);
+	atexit(stopLogger);
+	return true;
+}
+
+void stopLogger() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	writer.join();
+	drain();
+	if (droppedRecords() > 0) {
+		fprintf(stdout, "logger: %ld records dropped\n", droppedRecords());
+	}
+	if (binaryLog) {
+		fclose(binaryLog);
+		binaryLog = 0;
+	}
+}
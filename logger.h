@@ -0,0 +1,78 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "bitboard.h"
+
+// asynchronous logger: callers copy a record into a lock-free ring and
+// return, a background thread formats and writes it
+// a full ring drops the record (and counts it) rather than block the search
+
+// levels, lowest first
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+#define LOG_OFF 4
+
+// records below this level are compiled out: -DLOG_COMPILED_LEVEL=1 drops
+// every debug call site, arguments included
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_RING_SIZE 1024	// records, a power of two
+#define LOG_DATA_SIZE 232	// longest text, in bytes
+#define LOG_FLUSH_MS 5	// how long the writer sleeps when the ring is empty
+
+// record kinds
+#define LOG_KIND_TEXT 0
+#define LOG_KIND_BOARD 1	// Bitboard rows, BOARD_HEIGHT little-endian words
+
+// the binary log is the file magic followed by records, each a LogHeader
+// and length data bytes; text records are also written to stdout, board
+// records only to the binary log (see logView.cpp)
+#define LOG_FILE_MAGIC "TLOG1\n"
+#define LOG_FILE_MAGIC_SIZE 6
+
+struct LogHeader {
+	uint64_t micros;	// since the logger started
+	uint8_t kind;
+	uint8_t level;
+	uint16_t length;
+	uint32_t reserved;
+};
+
+// runtime level, records below it are skipped before they are formatted
+extern std::atomic<int> logLevel;
+
+// starts the writer thread; binaryPath may be 0 for console output only
+// returns false if the binary log cannot be created
+bool startLogger(const char* binaryPath);
+// writes out everything queued and stops the writer; also run at exit
+void stopLogger();
+void logText(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void logBoard(int level, const Bitboard& board);
+// records lost to a full ring
+long droppedRecords();
+// "debug", "info", "warn", "error" or "off", -1 if unknown
+int parseLogLevel(const char* name);
+const char* logLevelName(int level);
+
+#define LOG_ENABLED(level) ((level) >= LOG_COMPILED_LEVEL && (level) >= logLevel.load(std::memory_order_relaxed))
+
+#define LOG(level, ...) do { \
+	if (LOG_ENABLED(level)) { \
+		logText((level), __VA_ARGS__); \
+	} \
+} while (0)
+
+#define LOG_BOARD(level, board) do { \
+	if (LOG_ENABLED(level)) { \
+		logBoard((level), (board)); \
+	} \
+} while (0)
+
+#endif
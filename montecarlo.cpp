@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "montecarlo.h"
+#include "pieceGen.h"
+#include "reachability.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// one board in a tree: the placement that made it, and for each piece
+// that can come next the placements kept below it
+struct TreeNode {
+	Placement move;	// placement of the parent's piece
+	int score;	// its static score, the order unvisited children are tried in
+	int numClear;
+	int visits;
+	double total;	// sum of the values of the iterations through here
+	int children[7];	// first child for each next piece, -1 until expanded
+	int8_t numChildren[7];
+};
+
+// one thread's tree
+struct Tree {
+	vector<TreeNode> nodes;
+	PieceGenerator gen;	// random stream for the pieces past the preview
+	long candidates;
+};
+
+// what every tree of a decision shares
+struct TreeSearch {
+	const SearchContext* context;
+	const Weights* weights;
+	PieceModel model;
+	TrackedBoard root;
+	const int* pieces;
+	int plies;
+	int gaps[7];	// draws since each piece was dealt, after the known pieces
+	bool timed;
+	chrono::steady_clock::time_point deadline;
+};
+
+// placements the search considers for a piece
+static int treePlacements(const TreeSearch& search, const TrackedBoard& board, int piece, Placement* out) {
+	if (search.context->reachable) {
+		return generateReachable(board.board, piece, out, board.tops);
+	}
+	return generatePlacements(board.board, piece, out, board.tops);
+}
+
+static int drawPiece(PieceGenerator& gen, const PieceModel& model) {
+	/*
+		Deals the next unknown piece by the model's odds and ages the
+		generator the way nextPiece does.
+		Parameters:
+			gen (PieceGenerator): random stream and pieces dealt last
+			model (PieceModel): odds of each piece
+	*/
+	int64_t odds[7];
+	int64_t total = 0;
+	for (int i = 0; i < 7; ++i) {
+		odds[i] = gen.gaps[i] >= model.history ? max(model.weights[i], 0) : 0;
+		total += odds[i];
+	}
+	// the model gives every piece that can come no weight: take them evenly
+	if (total == 0) {
+		for (int i = 0; i < 7; ++i) {
+			odds[i] = gen.gaps[i] >= model.history ? 1 : 0;
+			total += odds[i];
+		}
+	}
+	int64_t pick = nextRandom(gen) % total;
+	int piece = 0;
+	while (pick >= odds[piece]) {
+		pick -= odds[piece++];
+	}
+	for (int i = 0; i < 7; ++i) {
+		if (gen.gaps[i] < model.history) {
+			gen.gaps[i]++;
+		}
+	}
+	gen.gaps[piece] = 0;
+	return piece;
+}
+
+// piece placed at depth: known from the preview, else dealt
+static int pieceAt(const TreeSearch& search, Tree& tree, int depth) {
+	return depth < search.plies ? search.pieces[depth] : drawPiece(tree.gen, search.model);
+}
+
+static bool expand(const TreeSearch& search, Tree& tree, int node, TrackedBoard& board, int piece, int keep) {
+	/*
+		Adds the keep best placements of piece by static score below node,
+		best first.
+		Parameters:
+			search (TreeSearch): the decision
+			tree (Tree): tree to grow
+			node (int): node whose board is board
+			board (TrackedBoard): left as it was on return
+			piece (int): piece to place
+			keep (int): most placements kept
+		Returns false, adding nothing, if the tree has no room left.
+	*/
+	Placement moves[MAX_PLACEMENTS];
+	int scores[MAX_PLACEMENTS];
+	int numClear[MAX_PLACEMENTS];
+	int order[MAX_PLACEMENTS];
+	if (tree.nodes.size() + keep > MAX_TREE_NODES) {
+		return false;
+	}
+	int count = treePlacements(search, board, piece, moves);
+	scorePlacements(board, piece, moves, count, *search.weights, scores, numClear);
+	tree.candidates += count;
+	for (int i = 0; i < count; ++i) {
+		order[i] = i;
+	}
+	// generation order breaks ties
+	stable_sort(order, order + count, [&](int a, int b) {
+		return scores[a] > scores[b];
+	});
+	count = min(count, keep);
+	tree.nodes[node].children[piece] = tree.nodes.size();
+	tree.nodes[node].numChildren[piece] = count;
+	for (int i = 0; i < count; ++i) {
+		TreeNode child = {moves[order[i]], scores[order[i]], numClear[order[i]], 0, 0.0, {-1, -1, -1, -1, -1, -1, -1},
+			{0}};
+		tree.nodes.push_back(child);
+	}
+	return true;
+}
+
+static int selectChild(const Tree& tree, int node, int piece) {
+	/*
+		UCT over the placements of piece below node: an unvisited child
+		first, best static score first; otherwise the best mean value,
+		scaled to [0, 1] between the worst and best sibling, plus the
+		exploration term.
+		Parameters:
+			tree (Tree): tree to walk
+			node (int): node to leave
+			piece (int): piece placed there this iteration
+	*/
+	int first = tree.nodes[node].children[piece];
+	int count = tree.nodes[node].numChildren[piece];
+	double low = 0;
+	double high = 0;
+	long visits = 0;
+	for (int i = first; i < first + count; ++i) {
+		const TreeNode& child = tree.nodes[i];
+		if (child.visits == 0) {
+			return i;
+		}
+		double mean = child.total / child.visits;
+		if (i == first || mean < low) {
+			low = mean;
+		}
+		if (i == first || mean > high) {
+			high = mean;
+		}
+		visits += child.visits;
+	}
+	double logVisits = log((double) visits);
+	int best = first;
+	double bestValue = 0;
+	for (int i = first; i < first + count; ++i) {
+		const TreeNode& child = tree.nodes[i];
+		double mean = child.total / child.visits;
+		double value = (high > low ? (mean - low) / (high - low) : 0.5) + EXPLORATION*sqrt(logVisits / child.visits);
+		if (i == first || value > bestValue) {
+			best = i;
+			bestValue = value;
+		}
+	}
+	return best;
+}
+
+static int rollout(const TreeSearch& search, Tree& tree, TrackedBoard& board, int piece, int depth, int lines, int last) {
+	/*
+		Value of an iteration that left the tree: places pieces up to
+		ROLLOUT_DEPTH, each where it scores best, and adds the lines they
+		clear to the shape of the last board.
+		Parameters:
+			search (TreeSearch): the decision
+			tree (Tree): tree whose stream deals the pieces
+			board (TrackedBoard): board the tree walk ended on; changed
+			piece (int): first piece to place, -1 to take the one at depth
+			depth (int): pieces placed so far
+			lines (int): lineScore of every placement so far
+			last (int): boardScore of board
+	*/
+	Placement moves[MAX_PLACEMENTS];
+	int scores[MAX_PLACEMENTS];
+	int numClear[MAX_PLACEMENTS];
+	TrackUndo undo;
+	for (; depth < ROLLOUT_DEPTH; ++depth) {
+		if (piece < 0) {
+			piece = pieceAt(search, tree, depth);
+		}
+		int count = treePlacements(search, board, piece, moves);
+		if (count == 0) {
+			return lines + LOSS_SCORE;
+		}
+		scorePlacements(board, piece, moves, count, *search.weights, scores, numClear);
+		tree.candidates += count;
+		int best = 0;
+		for (int j = 1; j < count; ++j) {
+			if (scores[best] < scores[j]) {
+				best = j;
+			}
+		}
+		trackLock(board, shapeMask(piece, moves[best].rot, moves[best].pivotX, moves[best].pivotY), undo);
+		lines += lineScore(numClear[best], *search.weights);
+		last = scores[best] - lineScore(numClear[best], *search.weights);
+		piece = -1;
+	}
+	return lines + last;
+}
+
+// one walk from the root to a new leaf, its rollout and the update of
+// every node on the way; every iteration places ROLLOUT_DEPTH pieces, so
+// the values of shallow and deep walks compare
+static void iterate(const TreeSearch& search, Tree& tree) {
+	TrackedBoard board = search.root;
+	TrackUndo undo;
+	int path[ROLLOUT_DEPTH + 1];
+	int length = 0;
+	int node = 0;
+	int lines = 0;
+	int last = 0;
+	int value;
+	for (int i = 0; i < 7; ++i) {
+		tree.gen.gaps[i] = search.gaps[i];
+	}
+	path[length++] = 0;
+	for (int depth = 0; ; ++depth) {
+		if (depth == ROLLOUT_DEPTH) {
+			value = lines + last;
+			break;
+		}
+		int piece = pieceAt(search, tree, depth);
+		if (tree.nodes[node].children[piece] < 0 && !expand(search, tree, node, board, piece, TREE_WIDTH)) {
+			value = rollout(search, tree, board, piece, depth, lines, last);
+			break;
+		}
+		if (tree.nodes[node].numChildren[piece] == 0) {
+			value = lines + LOSS_SCORE;
+			break;
+		}
+		node = selectChild(tree, node, piece);
+		const TreeNode& child = tree.nodes[node];
+		trackLock(board, shapeMask(piece, child.move.rot, child.move.pivotX, child.move.pivotY), undo);
+		lines += lineScore(child.numClear, *search.weights);
+		last = child.score - lineScore(child.numClear, *search.weights);
+		path[length++] = node;
+		if (child.visits == 0) {
+			value = rollout(search, tree, board, -1, depth + 1, lines, last);
+			break;
+		}
+	}
+	for (int i = 0; i < length; ++i) {
+		tree.nodes[path[i]].visits++;
+		tree.nodes[path[i]].total += value;
+	}
+}
+
+static void growTree(const TreeSearch& search, Tree& tree, uint64_t seed) {
+	/*
+		Expands the root, then iterates until the deadline, or
+		TREE_ITERATIONS times without one. The root is expanded even past
+		the deadline: the decision sums its children's visits over every
+		tree, and plays the best static score if none were visited.
+		Parameters:
+			search (TreeSearch): the decision
+			tree (Tree): empty tree to grow
+			seed (uint64_t): seed of the tree's random stream
+	*/
+	TreeNode root = {Placement(), 0, 0, 0, 0.0, {-1, -1, -1, -1, -1, -1, -1}, {0}};
+	const atomic<bool>* cancel = search.context->cancel;
+	TrackedBoard board = search.root;
+	seedGenerator(tree.gen, seed);
+	tree.candidates = 0;
+	tree.nodes.reserve(MAX_TREE_NODES / 8);
+	tree.nodes.push_back(root);
+	expand(search, tree, 0, board, search.pieces[0], TREE_WIDTH);
+	for (long i = 0; ; ++i) {
+		if (cancel && cancel->load(memory_order_relaxed)) {
+			break;
+		}
+		// an iteration places ROLLOUT_DEPTH pieces, so reading the clock
+		// before each one costs next to nothing
+		if (search.timed ? chrono::steady_clock::now() > search.deadline : i >= TREE_ITERATIONS) {
+			break;
+		}
+		iterate(search, tree);
+	}
+}
+
+SearchResult monteCarloMove(const Bitboard& board, const int* pieces, int plies, const SearchContext& context) {
+	/*
+		Grows one tree per pool thread and plays the root placement their
+		iterations visited most; ties go to the better static score.
+		Parameters:
+			board (Bitboard): current board
+			pieces (int*): current piece followed by the preview queue
+			plies (int): number of known pieces, capped at MAX_PLIES
+			context (SearchContext): pool, weights, piece model and budget;
+				the table is not used
+	*/
+	SearchResult result;
+	TreeSearch search;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	search.context = &context;
+	search.weights = context.weights ? context.weights : &defaultWeights;
+	search.model = context.model ? *context.model : clientModel;
+	if (search.model.history < 0 || search.model.history > 6) {
+		search.model = clientModel;
+	}
+	initTracked(search.root, board);
+	search.pieces = pieces;
+	search.plies = min(plies, MAX_PLIES);
+	// the pieces before pieces[0] are not known: every piece may come
+	for (int i = 0; i < 7; ++i) {
+		search.gaps[i] = search.model.history;
+	}
+	for (int i = 0; i < search.plies; ++i) {
+		for (int j = 0; j < 7; ++j) {
+			if (search.gaps[j] < search.model.history) {
+				search.gaps[j]++;
+			}
+		}
+		search.gaps[pieces[i]] = 0;
+	}
+	search.timed = context.budget > 0;
+	search.deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(context.budget));
+	result.found = false;
+	result.score = LOSS_SCORE;
+	result.moveInstr = 0;
+	result.candidates = 0;
+	result.plies = search.plies;
+	result.chancePlies = 0;
+	if (collides(board, shapeMask(pieces[0], 0, spawnPivot[pieces[0]][0], spawnPivot[pieces[0]][1]), 0, 0)) {
+		return result;
+	}
+
+	int numTrees = context.pool ? context.pool->size() : 1;
+	vector<Tree> trees(numTrees);
+	uint64_t seed = board.hash;
+	for (int i = 0; i < search.plies; ++i) {
+		seed = seed*31 + pieces[i];
+	}
+	if (context.pool && numTrees > 1) {
+		TaskGroup group;
+		for (int i = 0; i < numTrees; ++i) {
+			context.pool->submit(group, [&, i]() {
+				growTree(search, trees[i], seed + i);
+			});
+		}
+		context.pool->wait(group);
+	} else {
+		growTree(search, trees[0], seed);
+	}
+
+	// every tree expanded the root the same way, so children line up
+	const TreeNode& root = trees[0].nodes[0];
+	int first = root.children[pieces[0]];
+	int count = root.numChildren[pieces[0]];
+	long bestVisits = -1;
+	for (int i = 0; i < numTrees; ++i) {
+		result.candidates += trees[i].candidates;
+	}
+	for (int i = 0; i < count; ++i) {
+		long visits = 0;
+		double total = 0;
+		for (int j = 0; j < numTrees; ++j) {
+			visits += trees[j].nodes[first + i].visits;
+			total += trees[j].nodes[first + i].total;
+		}
+		if (visits > bestVisits) {
+			bestVisits = visits;
+			result.found = true;
+			result.move = trees[0].nodes[first + i].move;
+			result.score = visits > 0 ? (int) floor(total / visits) : trees[0].nodes[first + i].score;
+		}
+	}
+	// reachable placements are sent as paths, not moveInstr
+	if (result.found && !context.reachable) {
+		result.moveInstr = encodeMove(result.move);
+	}
+	return result;
+}
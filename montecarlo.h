@@ -0,0 +1,27 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include "search.h"
+
+// Monte Carlo tree search: an anytime alternative to the beam search
+// every pool thread grows its own tree from the current board; each
+// iteration walks down by UCT, deals the pieces past the preview from the
+// context's PieceModel, and scores the new leaf with a rollout that places
+// the rest of its ROLLOUT_DEPTH pieces the way findFit did (the best static
+// score); the trees' root visit counts are added up and the most visited
+// move wins
+
+#define TREE_WIDTH 8	// placements a tree node keeps per piece, best static score first
+#define ROLLOUT_DEPTH 5	// pieces every iteration places, down the tree and then by rollout
+#define TREE_ITERATIONS 2000	// iterations per tree without a budget
+#define MAX_TREE_NODES (1 << 17)	// nodes per tree; a full tree only runs rollouts
+#define EXPLORATION 0.5	// UCT constant, on child values scaled to [0, 1] among siblings
+
+// best visited placement of pieces[0] after context.budget seconds, or
+// TREE_ITERATIONS iterations per thread without a budget; score is the
+// mean value of its iterations
+// without a budget the result depends on the thread count but not on
+// timing
+SearchResult monteCarloMove(const Bitboard& board, const int* pieces, int plies, const SearchContext& context);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PIECEGEN_H
+#define PIECEGEN_H
+
+#include <stdint.h>
+
+// seeded copy of the client's getNext: a piece is dealt uniformly from the
+// ones that have not been dealt in the last three draws
+struct PieceGenerator {
+	uint64_t state;
+	int gaps[7];	// draws since each piece was last dealt, capped at 3
+};
+
+inline void seedGenerator(PieceGenerator& gen, uint64_t seed) {
+	gen.state = seed;
+	for (int i = 0; i < 7; ++i) {
+		gen.gaps[i] = 3;
+	}
+}
+
+// splitmix64 step
+inline uint64_t nextRandom(PieceGenerator& gen) {
+	uint64_t z = (gen.state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+inline int nextPiece(PieceGenerator& gen) {
+	/*
+		Draws the next piece the way the client does: retry until the
+		piece has been away for three draws, then age every other piece.
+		Parameters:
+			gen (PieceGenerator): generator to advance
+	*/
+	int temp;
+	do {
+		temp = nextRandom(gen) % 7;
+	} while (gen.gaps[temp] != 3);
+	for (int i = 0; i < 7; ++i) {
+		if (gen.gaps[i] < 3) {
+			gen.gaps[i]++;
+		}
+	}
+	gen.gaps[temp] = 0;
+	return temp;
+}
+
+#endif
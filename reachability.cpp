@@ -0,0 +1,153 @@
+#include <cstring>
+
+#include "reachability.h"
+
+using namespace std;
+
+// explore keeps one placement per landed key
+static_assert(MAX_PLACEMENTS >= REACH_STATES, "placement room");
+
+// states as stored in the search queue
+static inline int stateIndex(int pivotX, int pivotY, int rot) {
+	return (pivotY*BOARD_WIDTH + pivotX)*4 + rot;
+}
+
+// breadth-first search bookkeeping; parents are only read by findPath
+struct Explorer {
+	uint64_t visited[(REACH_STATES + 63) / 64];
+	uint64_t landed[(REACH_STATES + 63) / 64];
+	int16_t queue[REACH_STATES];
+	int16_t parent[REACH_STATES];
+	uint8_t input[REACH_STATES];
+	uint8_t depth[REACH_STATES];
+	int head;
+	int tail;
+};
+
+static inline bool testBit(const uint64_t* bits, int index) {
+	return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static inline void setBit(uint64_t* bits, int index) {
+	bits[index >> 6] |= 1ULL << (index & 63);
+}
+
+// queues a state the first time it is reached
+static inline void visit(Explorer& explorer, int from, int inputCode, int pivotX, int pivotY, int rot) {
+	int index = stateIndex(pivotX, pivotY, rot);
+	if (testBit(explorer.visited, index)) {
+		return;
+	}
+	setBit(explorer.visited, index);
+	explorer.parent[index] = from;
+	explorer.input[index] = inputCode;
+	explorer.depth[index] = from < 0 ? 0 : explorer.depth[from] + 1;
+	explorer.queue[explorer.tail++] = index;
+}
+
+static int explore(const Bitboard& board, const int8_t* tops, int piece, Explorer& explorer, Placement* out, int target) {
+	/*
+		Breadth-first search over piece states from spawn, one input per
+		edge, so the first time a state is reached is along a shortest
+		path.
+		Parameters:
+			board (Bitboard): board to move on
+			tops (int8_t*): columnTops of board
+			piece (int): piece index
+			explorer (Explorer): search state, filled in
+			out (Placement*): room for MAX_PLACEMENTS, or 0
+			target (int): stop once this state is reached, -1 for never
+		Returns the number of placements written to out.
+	*/
+	int count = 0;
+	memset(explorer.visited, 0, sizeof(explorer.visited));
+	memset(explorer.landed, 0, sizeof(explorer.landed));
+	explorer.head = 0;
+	explorer.tail = 0;
+	if (collides(board, shapeMask(piece, 0, spawnPivot[piece][0], spawnPivot[piece][1]), 0, 0)) {
+		return 0;
+	}
+	visit(explorer, -1, 0, spawnPivot[piece][0], spawnPivot[piece][1], 0);
+	while (explorer.head < explorer.tail) {
+		int index = explorer.queue[explorer.head++];
+		if (index == target) {
+			break;
+		}
+		int rot = index & 3;
+		int pivotX = (index >> 2) % BOARD_WIDTH;
+		int pivotY = (index >> 2) / BOARD_WIDTH;
+		PieceMask mask = shapeMask(piece, rot, pivotX, pivotY);
+		bool resting = collides(board, mask, 0, -1);
+		if (resting && out) {
+			int key = (mask.y*BOARD_WIDTH + mask.x)*4 + canonicalRotations.rots[piece][rot];
+			if (!testBit(explorer.landed, key)) {
+				setBit(explorer.landed, key);
+				Placement& move = out[count++];
+				move.rot = rot;
+				move.pivotX = pivotX;
+				move.pivotY = pivotY;
+				move.turns = 0;
+				move.shift = 0;
+			}
+		}
+		// longer paths would not fit in a reply
+		if (explorer.depth[index] == MAX_PATH) {
+			continue;
+		}
+		int newRot = rot, newX = pivotX, newY = pivotY;
+		if (tryRotate(board, piece, newRot, newX, newY, 1)) {
+			visit(explorer, index, PATH_CW, newX, newY, newRot);
+		}
+		newRot = rot, newX = pivotX, newY = pivotY;
+		if (tryRotate(board, piece, newRot, newX, newY, -1)) {
+			visit(explorer, index, PATH_CCW, newX, newY, newRot);
+		}
+		if (!collides(board, mask, -1, 0)) {
+			visit(explorer, index, PATH_LEFT, pivotX - 1, pivotY, rot);
+		}
+		if (!collides(board, mask, 1, 0)) {
+			visit(explorer, index, PATH_RIGHT, pivotX + 1, pivotY, rot);
+		}
+		if (!resting) {
+			visit(explorer, index, PATH_DROP, pivotX, pivotY - landingDistance(board, tops, piece, rot, mask, 0), rot);
+		}
+	}
+	return count;
+}
+
+int generateReachable(const Bitboard& board, int piece, Placement* out, const int8_t* tops) {
+	Explorer explorer;
+	int8_t ownTops[BOARD_WIDTH];
+	if (!tops) {
+		columnTops(board, ownTops);
+		tops = ownTops;
+	}
+	return explore(board, tops, piece, explorer, out, -1);
+}
+
+int findPath(const Bitboard& board, int piece, const Placement& move, uint8_t* inputs) {
+	/*
+		Rebuilds the input path to a placement from generateReachable.
+		Parameters:
+			board (Bitboard): board the placement was generated on
+			piece (int): piece index
+			move (Placement): placement to reach
+			inputs (uint8_t*): out, room for MAX_PATH inputs
+	*/
+	Explorer explorer;
+	int8_t tops[BOARD_WIDTH];
+	if (move.pivotX < 0 || move.pivotX >= BOARD_WIDTH || move.pivotY < 0 || move.pivotY >= BOARD_HEIGHT) {
+		return -1;
+	}
+	int target = stateIndex(move.pivotX, move.pivotY, move.rot);
+	columnTops(board, tops);
+	explore(board, tops, piece, explorer, 0, target);
+	if (!testBit(explorer.visited, target)) {
+		return -1;
+	}
+	int length = explorer.depth[target];
+	for (int index = target, i = length - 1; i >= 0; index = explorer.parent[index], --i) {
+		inputs[i] = explorer.input[index];
+	}
+	return length;
+}
@@ -0,0 +1,29 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <stdint.h>
+
+#include "frame.h"
+#include "search.h"
+
+// every lock position a piece can reach with single inputs from spawn:
+// shifts, SRS turns both ways and drops, so placements under overhangs
+// (tucks and slides) and kicked spins are found as well as hard drops
+// states are (pivotX, pivotY, rotation); the pivot is always one of the
+// piece's tiles, so a state fits in (y*10 + x)*4 + rot < REACH_STATES and
+// the visited set is a bitset of that size
+#define REACH_STATES (BOARD_WIDTH * BOARD_HEIGHT * 4)
+// longest input path kept, so every path fits in one 'P' frame
+#define MAX_PATH MAX_PAYLOAD
+
+// finds every distinct lock position (by the cells it fills), each through
+// its shortest input path; returns the count, at most MAX_PLACEMENTS
+// the placements' turns and shift are 0: they are sent as paths
+// tops is the board's columnTops, worked out here if null
+int generateReachable(const Bitboard& board, int piece, Placement* out, const int8_t* tops = 0);
+
+// shortest input path (PATH_* codes) that locks piece at move
+// returns the path length, or -1 if move is not reachable
+int findPath(const Bitboard& board, int piece, const Placement& move, uint8_t* inputs);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef ROTATIONDATA_H
+#define ROTATIONDATA_H
+
+#include <stdint.h>
+
+// SRS rotation data shared by the server and the Arduino client.
+// Pieces are indexed I, J, L, O, S, T, Z (same as tetromino[]) and
+// rotation indices run clockwise from the spawn orientation.
+// Every piece turns about its first tile (the pivot), so a piece is fully
+// described by its pivot position, piece index and rotation index.
+
+// pivot position of each piece when it spawns (first tile of tetromino[])
+constexpr int8_t spawnPivot[7][2] = {{4, 18}, {5, 18}, {5, 18}, {4, 18}, {5, 18}, {5, 18}, {5, 18}};
+
+// tile offsets from the pivot for each piece and rotation
+// O never turns: a failed rotation puts it back where it started
+constexpr int8_t pieceCells[7][4][4][2] = {
+	{{{0, 0}, {-1, 0}, {1, 0}, {2, 0}},
+	 {{0, 0}, {0, 1}, {0, -1}, {0, -2}},
+	 {{0, 0}, {1, 0}, {-1, 0}, {-2, 0}},
+	 {{0, 0}, {0, -1}, {0, 1}, {0, 2}}},	// I
+	{{{0, 0}, {-1, 0}, {-1, 1}, {1, 0}},
+	 {{0, 0}, {0, 1}, {1, 1}, {0, -1}},
+	 {{0, 0}, {1, 0}, {1, -1}, {-1, 0}},
+	 {{0, 0}, {0, -1}, {-1, -1}, {0, 1}}},	// J
+	{{{0, 0}, {-1, 0}, {1, 0}, {1, 1}},
+	 {{0, 0}, {0, 1}, {0, -1}, {1, -1}},
+	 {{0, 0}, {1, 0}, {-1, 0}, {-1, -1}},
+	 {{0, 0}, {0, -1}, {0, 1}, {-1, 1}}},	// L
+	{{{0, 0}, {1, 1}, {0, 1}, {1, 0}},
+	 {{0, 0}, {1, 1}, {0, 1}, {1, 0}},
+	 {{0, 0}, {1, 1}, {0, 1}, {1, 0}},
+	 {{0, 0}, {1, 1}, {0, 1}, {1, 0}}},	// O
+	{{{0, 0}, {-1, 0}, {0, 1}, {1, 1}},
+	 {{0, 0}, {0, 1}, {1, 0}, {1, -1}},
+	 {{0, 0}, {1, 0}, {0, -1}, {-1, -1}},
+	 {{0, 0}, {0, -1}, {-1, 0}, {-1, 1}}},	// S
+	{{{0, 0}, {-1, 0}, {0, 1}, {1, 0}},
+	 {{0, 0}, {0, 1}, {1, 0}, {0, -1}},
+	 {{0, 0}, {1, 0}, {0, -1}, {-1, 0}},
+	 {{0, 0}, {0, -1}, {-1, 0}, {0, 1}}},	// T
+	{{{0, 0}, {0, 1}, {-1, 1}, {1, 0}},
+	 {{0, 0}, {1, 0}, {1, 1}, {0, -1}},
+	 {{0, 0}, {0, -1}, {1, -1}, {-1, 0}},
+	 {{0, 0}, {-1, 0}, {-1, -1}, {0, 1}}}	// Z
+};
+
+// kick offsets tried in order when turning, indexed
+// [piece][old rotation][0 = clockwise, 1 = counter-clockwise][test][x, y]
+// each entry is the old minus the new SRS offset, so the first test that
+// does not collide is added to the pivot
+constexpr int8_t rotationKicks[7][4][2][5][2] = {
+	{{{{1, 0}, {-1, 0}, {2, 0}, {-1, -1}, {2, 2}}, {{0, -1}, {-1, -1}, {2, -1}, {-1, 1}, {2, -2}}},
+	 {{{0, -1}, {-1, -1}, {2, -1}, {-1, 1}, {2, -2}}, {{-1, 0}, {1, 0}, {-2, 0}, {1, 1}, {-2, -2}}},
+	 {{{-1, 0}, {1, 0}, {-2, 0}, {1, 1}, {-2, -2}}, {{0, 1}, {1, 1}, {-2, 1}, {1, -1}, {-2, 2}}},
+	 {{{0, 1}, {1, 1}, {-2, 1}, {1, -1}, {-2, 2}}, {{1, 0}, {-1, 0}, {2, 0}, {-1, -1}, {2, 2}}}},	// I
+	{{{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+	 {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+	 {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+	 {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},	// J
+	{{{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+	 {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+	 {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+	 {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},	// L
+	{{{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+	 {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+	 {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},
+	 {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}}},	// O
+	{{{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+	 {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+	 {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+	 {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},	// S
+	{{{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+	 {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+	 {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+	 {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},	// T
+	{{{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+	 {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+	 {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+	 {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}}	// Z
+};
+
+// footprint of a piece as row masks
+// rows[0] is the bottom row with the leftmost tile on bit 0; left and
+// bottom are the offsets of that corner from the pivot
+struct PieceShape {
+	uint16_t rows[4];
+	int8_t left;
+	int8_t bottom;
+	int8_t width;
+	int8_t height;
+};
+
+constexpr PieceShape pieceShapes[7][4] = {
+	{{{0xF, 0x0, 0x0, 0x0}, -1, 0, 4, 1},
+	 {{0x1, 0x1, 0x1, 0x1}, 0, -2, 1, 4},
+	 {{0xF, 0x0, 0x0, 0x0}, -2, 0, 4, 1},
+	 {{0x1, 0x1, 0x1, 0x1}, 0, -1, 1, 4}},	// I
+	{{{0x7, 0x1, 0x0, 0x0}, -1, 0, 3, 2},
+	 {{0x1, 0x1, 0x3, 0x0}, 0, -1, 2, 3},
+	 {{0x4, 0x7, 0x0, 0x0}, -1, -1, 3, 2},
+	 {{0x3, 0x2, 0x2, 0x0}, -1, -1, 2, 3}},	// J
+	{{{0x7, 0x4, 0x0, 0x0}, -1, 0, 3, 2},
+	 {{0x3, 0x1, 0x1, 0x0}, 0, -1, 2, 3},
+	 {{0x1, 0x7, 0x0, 0x0}, -1, -1, 3, 2},
+	 {{0x2, 0x2, 0x3, 0x0}, -1, -1, 2, 3}},	// L
+	{{{0x3, 0x3, 0x0, 0x0}, 0, 0, 2, 2},
+	 {{0x3, 0x3, 0x0, 0x0}, 0, 0, 2, 2},
+	 {{0x3, 0x3, 0x0, 0x0}, 0, 0, 2, 2},
+	 {{0x3, 0x3, 0x0, 0x0}, 0, 0, 2, 2}},	// O
+	{{{0x3, 0x6, 0x0, 0x0}, -1, 0, 3, 2},
+	 {{0x2, 0x3, 0x1, 0x0}, 0, -1, 2, 3},
+	 {{0x3, 0x6, 0x0, 0x0}, -1, -1, 3, 2},
+	 {{0x2, 0x3, 0x1, 0x0}, -1, -1, 2, 3}},	// S
+	{{{0x7, 0x2, 0x0, 0x0}, -1, 0, 3, 2},
+	 {{0x1, 0x3, 0x1, 0x0}, 0, -1, 2, 3},
+	 {{0x2, 0x7, 0x0, 0x0}, -1, -1, 3, 2},
+	 {{0x2, 0x3, 0x2, 0x0}, -1, -1, 2, 3}},	// T
+	{{{0x6, 0x3, 0x0, 0x0}, -1, 0, 3, 2},
+	 {{0x1, 0x3, 0x2, 0x0}, 0, -1, 2, 3},
+	 {{0x6, 0x3, 0x0, 0x0}, -1, -1, 3, 2},
+	 {{0x1, 0x3, 0x2, 0x0}, -1, -1, 2, 3}}	// Z
+};
+
+#endif
@@ -0,0 +1,808 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "evaluate.h"
+#include "montecarlo.h"
+#include "reachability.h"
+#include "search.h"
+#include "threadPool.h"
+#include "transposition.h"
+
+using namespace std;
+
+const PieceModel clientModel = {3, {1, 1, 1, 1, 1, 1, 1}};
+
+// below every value, so a chance node given it as alpha is never cut
+#define NO_CUT (LOSS_SCORE - 1)
+
+// what the generator has dealt lately: draws since each piece was last
+// dealt, capped at the model's history; pieces dealt before the search's
+// first piece are not known, so they count as long gone
+struct DealState {
+	int8_t gaps[7];
+};
+
+// one searchMove call: the caller's context plus what the search works
+// out once per decision
+struct SearchRun : SearchContext {
+	PieceModel pieceModel;	// the context's model, checked
+	uint64_t modelKeys[2];	// table key of the model, as it is and mirrored
+	int firstChance;	// chance plies of the whole run; the first chance ply is never sampled
+	bool bounded;	// no weight is negative, so chanceBound holds
+	bool timed;
+	chrono::steady_clock::time_point deadline;
+	mutable atomic<bool> expired;	// set once the deadline has passed
+
+	explicit SearchRun(const SearchContext& context) : SearchContext(context), firstChance(0), bounded(false),
+		timed(false), expired(false) {}
+};
+
+// a scored placement waiting to be expanded; its move is moves[index] in
+// the caller's buffer and is made again when the child is searched, so
+// sorting only moves these few words
+struct Child {
+	int numClear;
+	int score;
+	int index;
+	uint64_t cells;	// tie break, see placementCells
+};
+
+int generatePlacements(const Bitboard& board, int piece, Placement* out, const int8_t* tops) {
+	/*
+		Enumerates the placements the client can reach with the
+		turn-shift-drop instructions it understands. Turns that fill the
+		same cells (I, O, S and Z) give one placement, reached by the
+		instruction with the fewest client actions.
+		Parameters:
+			board (Bitboard): board to place on
+			piece (int): piece index
+			out (Placement*): room for MAX_PLACEMENTS placements
+			tops (int8_t*): columnTops of board, or null
+	*/
+	int count = 0;
+	int rot, pivotX, pivotY;
+	int moveLeft, moveRight;
+	PieceMask mask;
+	// placement already found at each canonical rotation and mask column
+	int8_t found[4][BOARD_WIDTH];
+	int8_t ownTops[BOARD_WIDTH];
+	if (!tops) {
+		columnTops(board, ownTops);
+		tops = ownTops;
+	}
+	// game over if the piece cannot spawn
+	if (collides(board, shapeMask(piece, 0, spawnPivot[piece][0], spawnPivot[piece][1]), 0, 0)) {
+		return 0;
+	}
+	memset(found, -1, sizeof(found));
+	// outer rotation loop
+	for (int i = 0; i < 4; ++i) {
+		// O turns in place: every turn is the same placements for more actions
+		if (i > 0 && canonicalRotations.rots[piece][3] == 0) {
+			break;
+		}
+		// turn the piece at spawn the same way the client will
+		rot = 0;
+		pivotX = spawnPivot[piece][0];
+		pivotY = spawnPivot[piece][1];
+		for (int j = 0; j < i; ++j) {
+			tryRotate(board, piece, rot, pivotX, pivotY, 1);
+		}
+		mask = shapeMask(piece, rot, pivotX, pivotY);
+		// calc max right & left without moving the piece
+		moveRight = 0;
+		while (!collides(board, mask, moveRight + 1, 0)) {
+			moveRight++;
+		}
+		moveLeft = 0;
+		while (!collides(board, mask, -moveLeft - 1, 0)) {
+			moveLeft++;
+		}
+		// every column from max left to max right
+		int canonical = canonicalRotations.rots[piece][rot];
+		for (int j = -moveLeft; j <= moveRight; ++j) {
+			int landing = pivotY - landingDistance(board, tops, piece, rot, mask, j);
+			int bottom = landing + pieceShapes[piece][rot].bottom;
+			int8_t& slot = found[canonical][mask.x + j];
+			if (slot >= 0 && out[slot].pivotY + pieceShapes[piece][out[slot].rot].bottom == bottom) {
+				// same cells as an earlier turn: keep the cheaper instruction
+				Placement& other = out[slot];
+				if (i + abs(j) < other.turns + abs(other.shift)) {
+					other.rot = rot;
+					other.pivotX = pivotX + j;
+					other.pivotY = landing;
+					other.turns = i;
+					other.shift = j;
+				}
+				continue;
+			}
+			slot = count;
+			Placement& move = out[count++];
+			move.rot = rot;
+			move.pivotX = pivotX + j;
+			move.pivotY = landing;
+			move.turns = i;
+			move.shift = j;
+		}
+	}
+	return count;
+}
+
+int encodeMove(const Placement& move) {
+	int moveInstr = move.shift*10;
+	if (moveInstr == 0) {
+		moveInstr = 90;
+	}
+	if (moveInstr > 0) {
+		moveInstr += move.turns;
+	} else {
+		moveInstr -= move.turns;
+	}
+	return moveInstr;
+}
+
+// splitmix64, used to derive the piece sequence keys
+static constexpr uint64_t mixKey(uint64_t n) {
+	n = (n + 1) * 0x9E3779B97F4A7C15ULL;
+	n = (n ^ (n >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	n = (n ^ (n >> 27)) * 0x94D049BB133111EBULL;
+	return n ^ (n >> 31);
+}
+
+// each row mirrored left to right
+struct MirrorRows {
+	uint16_t rows[1 << BOARD_WIDTH];
+
+	constexpr MirrorRows() : rows() {
+		for (int row = 0; row < (1 << BOARD_WIDTH); ++row) {
+			for (int x = 0; x < BOARD_WIDTH; ++x) {
+				if ((row >> x) & 1) {
+					rows[row] |= 1 << (BOARD_WIDTH - 1 - x);
+				}
+			}
+		}
+	}
+};
+
+static constexpr MirrorRows mirrorRows;
+
+// I, L, J, O, Z, T, S: the piece whose mirror image each piece is
+static const int mirrorPiece[7] = {0, 2, 1, 3, 6, 5, 4};
+
+// lowest row a piece reaches while it turns and shifts at spawn
+static constexpr int lowestSpawnRow() {
+	int lowest = BOARD_HEIGHT;
+	for (int piece = 0; piece < 7; ++piece) {
+		for (int rot = 0; rot < 4; ++rot) {
+			for (int i = 0; i < 4; ++i) {
+				lowest = min(lowest, spawnPivot[piece][1] + pieceCells[piece][rot][i][1]);
+			}
+		}
+	}
+	return lowest;
+}
+
+// a stack whose tops stay at or below this row never touches a piece before
+// it drops, so its turn-shift-drops are the mirror images of the mirrored
+// stack's; SRS kicks are not symmetric, so reachable placements never are
+static constexpr int MIRROR_TOP = lowestSpawnRow();
+
+// table key of a board and piece sequence
+static uint64_t sequenceKey(uint64_t boardHash, const int* pieces, int plies, bool reachable, const int* pieceMap) {
+	uint64_t key = boardHash ^ mixKey(1000 + plies) ^ (reachable ? mixKey(3000) : 0);
+	for (int i = 0; i < plies; ++i) {
+		key ^= mixKey(2000 + i*8 + (pieceMap ? pieceMap[pieces[i]] : pieces[i]));
+	}
+	return key;
+}
+
+// table key of what an expectimax subtree knows of the unknown pieces: how
+// many, how many of them are sampled (those below the run's first chance
+// ply), their odds and the pieces dealt last; 0 without unknown pieces
+static uint64_t dealKey(const DealState& dealt, int chance, const SearchRun& context, const int* pieceMap) {
+	if (chance == 0) {
+		return 0;
+	}
+	uint64_t key = mixKey(4000 + chance) ^ mixKey(4100 + min(chance, context.firstChance - 1)) ^ context.modelKeys[pieceMap != 0];
+	for (int i = 0; i < 7; ++i) {
+		key ^= mixKey(5000 + (pieceMap ? pieceMap[i] : i)*8 + dealt.gaps[i]);
+	}
+	return key;
+}
+
+// table key of a piece model; pieceMap[i] is the piece whose odds piece i
+// takes, so a mirrored subtree uses the mirrored odds
+static uint64_t modelKey(const PieceModel& model, const int* pieceMap) {
+	uint64_t key = mixKey(6000 + model.history);
+	for (int i = 0; i < 7; ++i) {
+		key = mixKey(key ^ ((uint64_t) (uint32_t) model.weights[pieceMap ? pieceMap[i] : i] << 3 | i));
+	}
+	return key;
+}
+
+static uint64_t subtreeKey(const TrackedBoard& tracked, const int* pieces, int plies, int chance, const DealState& dealt,
+		const SearchRun& context, bool* flipped = 0) {
+	/*
+		Table key of a subtree: the board plus the pieces still to place,
+		known and unknown, and whether they are placed by turn-shift-drops
+		or any path.
+		With context.mirrored, a subtree and its mirror image share the
+		smaller of their two keys, as long as no piece in the subtree can
+		land high enough to touch a piece at spawn: every piece adds at
+		most 4 rows. Placements that tie on score are ordered by their
+		cells as seen from the key's side, so both keep the same beam.
+		Parameters:
+			tracked (TrackedBoard): board before pieces[0] is placed
+			pieces (int*): known upcoming pieces
+			plies (int): number of known pieces left to place
+			chance (int): number of unknown pieces after them
+			dealt (DealState): pieces dealt last, for the unknown ones
+			context (SearchRun): the search's options
+			flipped (bool*): out if not null, true if the key is the
+				mirror image's, whose piece i is mirrorPiece[i] here
+	*/
+	uint64_t key = sequenceKey(tracked.board.hash, pieces, plies, context.reachable, 0) ^ dealKey(dealt, chance, context, 0);
+	if (flipped) {
+		*flipped = false;
+	}
+	if (!context.mirrored || context.reachable) {
+		return key;
+	}
+	int highest = 0;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		highest = max(highest, (int) tracked.tops[i]);
+	}
+	if (highest + 4*(plies + chance - 1) > MIRROR_TOP) {
+		return key;
+	}
+	uint64_t hash = 0;
+	for (int i = 0; i < highest; ++i) {
+		hash ^= rowKey(i, mirrorRows.rows[tracked.board.rows[i]]);
+	}
+	uint64_t mirrored = sequenceKey(hash, pieces, plies, false, mirrorPiece) ^ dealKey(dealt, chance, context, mirrorPiece);
+	if (flipped) {
+		*flipped = mirrored < key;
+	}
+	return min(key, mirrored);
+}
+
+uint64_t tableTag(const Weights& weights) {
+	uint64_t tag = mixKey(MAX_PLIES) ^ mixKey(100 + BEAM_WIDTH) ^ mixKey(200 + MAX_PLACEMENTS) ^ mixKey(300 + CHANCE_SAMPLES);
+	const int values[] = {weights.height, weights.flat, weights.hole, weights.line, weights.death, weights.pit};
+	for (int i = 0; i < 6; ++i) {
+		tag = mixKey(tag ^ (uint32_t) values[i]);
+	}
+	return tag;
+}
+
+// weights a search evaluates with
+static const Weights& contextWeights(const SearchContext& context) {
+	return context.weights ? *context.weights : defaultWeights;
+}
+
+// placements the search considers for a piece on a tracked board
+static int contextPlacements(const SearchContext& context, const TrackedBoard& tracked, int piece, Placement* out) {
+	if (context.reachable) {
+		return generateReachable(tracked.board, piece, out, tracked.tops);
+	}
+	return generatePlacements(tracked.board, piece, out, tracked.tops);
+}
+
+// true once the owner of the search has given up on it, or its expectimax
+// search has run out of time
+static bool cancelled(const SearchRun& context) {
+	return (context.cancel && context.cancel->load(memory_order_relaxed)) || context.expired.load(memory_order_relaxed);
+}
+
+// cancelled, or past the deadline; reads the clock, so only nodes that
+// are about to generate placements or average pieces ask
+static bool outOfTime(const SearchRun& context) {
+	if (context.timed && !context.expired.load(memory_order_relaxed) && chrono::steady_clock::now() > context.deadline) {
+		context.expired.store(true, memory_order_relaxed);
+	}
+	return cancelled(context);
+}
+
+// the generator after it deals piece
+static DealState dealPiece(const DealState& dealt, int piece, int history) {
+	DealState next = dealt;
+	for (int i = 0; i < 7; ++i) {
+		if (next.gaps[i] < history) {
+			next.gaps[i]++;
+		}
+	}
+	next.gaps[piece] = 0;
+	return next;
+}
+
+static int chanceBound(const TrackedBoard& tracked, int pieces, const Weights& weights) {
+	/*
+		Highest value a board can reach in the next few placements, for
+		star pruning. No weight is negative, so boardScore is never
+		positive and only line clears add to a value; pieces*4 cells
+		complete at most the rows that are cheapest to fill, and clearing
+		them all at once scores the most.
+		Parameters:
+			tracked (TrackedBoard): board before the pieces
+			pieces (int): number of pieces still to place
+			weights (Weights): evaluation weights
+	*/
+	int rows[BOARD_WIDTH + 1] = {0};
+	for (int j = 0; j < BOARD_HEIGHT; ++j) {
+		rows[BOARD_WIDTH - tracked.rowFill[j]]++;
+	}
+	int cells = 4*pieces;
+	int lines = 0;
+	for (int missing = 1; missing <= BOARD_WIDTH; ++missing) {
+		int filled = min(rows[missing], cells / missing);
+		lines += filled;
+		cells -= filled*missing;
+	}
+	int bound = 0;
+	for (int i = 0; i < pieces; ++i) {
+		int numClear = min(lines, 4);
+		bound += max(1, lineScore(numClear, weights));
+		lines -= numClear;
+	}
+	return bound;
+}
+
+// rounded down, so an average stays under every bound it was cut at
+static int floorDiv(int64_t sum, int64_t total) {
+	int64_t quotient = sum / total;
+	return quotient - (sum % total < 0 ? 1 : 0);
+}
+
+void scorePlacements(TrackedBoard& tracked, int piece, const Placement* moves, int count, const Weights& weights,
+		int* scores, int* numClear) {
+	/*
+		Makes every placement on the board, reads its features and takes
+		it back, then scores them BATCH_SIZE at a time.
+		Parameters:
+			tracked (TrackedBoard): board before the piece is placed, left
+				as it was on return
+			piece (int): piece index
+			moves (Placement*): placements to make
+			count (int): number of placements, at most MAX_PLACEMENTS
+			weights (Weights): evaluation weights
+			scores (int*): out, static score of each placement
+			numClear (int*): out, lines each placement clears
+	*/
+	FeatureBatch batch = {};
+	TrackUndo undo;
+	// one batch almost always holds them all
+	for (int start = 0; start < count; start += BATCH_SIZE) {
+		int size = min(count - start, BATCH_SIZE);
+		for (int i = 0; i < size; ++i) {
+			const Placement& move = moves[start + i];
+			numClear[start + i] = trackLock(tracked, shapeMask(piece, move.rot, move.pivotX, move.pivotY), undo);
+			extractFeatures(tracked, batch, i);
+			trackUndo(tracked, undo);
+		}
+		scoreFeatures(batch, size, weights, scores + start);
+	}
+	for (int i = 0; i < count; ++i) {
+		scores[i] += lineScore(numClear[i], weights);
+	}
+}
+
+// the lowest row a placement fills and its four rows from there, mirrored
+// if flipped; a placement on a board whose key is flipped (see subtreeKey)
+// gets the same value as its mirror image on the mirrored board
+static uint64_t placementCells(int piece, const Placement& move, bool flipped) {
+	PieceMask mask = shapeMask(piece, move.rot, move.pivotX, move.pivotY);
+	uint64_t cells = mask.y;
+	for (int i = 0; i < 4; ++i) {
+		int row = mask.rows[i] << mask.x;
+		cells = cells << BOARD_WIDTH | (flipped ? mirrorRows.rows[row] : row);
+	}
+	return cells;
+}
+
+// scores every placement as a child of the node
+// flipped is whether the node's table key is its mirror image's
+static void makeChildren(TrackedBoard& tracked, int piece, const Placement* moves, int count,
+		const Weights& weights, bool flipped, Child* children) {
+	int scores[MAX_PLACEMENTS];
+	int numClear[MAX_PLACEMENTS];
+	scorePlacements(tracked, piece, moves, count, weights, scores, numClear);
+	for (int i = 0; i < count; ++i) {
+		children[i].numClear = numClear[i];
+		children[i].score = scores[i];
+		children[i].index = i;
+		children[i].cells = placementCells(piece, moves[i], flipped);
+	}
+}
+
+// best child first; ties go by the cells the placements fill, not by the
+// order they were generated in, so a board and its mirror image keep the
+// same children when a beam cut falls on a tie
+static void sortChildren(Child* children, int count) {
+	for (int i = 1; i < count; ++i) {
+		Child temp = children[i];
+		int j = i - 1;
+		while (j >= 0 && (children[j].score < temp.score ||
+				(children[j].score == temp.score && children[j].cells > temp.cells))) {
+			children[j + 1] = children[j];
+			j--;
+		}
+		children[j + 1] = temp;
+	}
+}
+
+static int searchNode(TrackedBoard& tracked, const int* pieces, int plies, int chance, const DealState& dealt, int alpha,
+	const SearchRun& context, long& candidates);
+
+// raises best to value, whichever thread gets there first
+static void raiseBest(atomic<int>& best, int value) {
+	int current = best.load(memory_order_relaxed);
+	while (current < value && !best.compare_exchange_weak(current, value, memory_order_relaxed)) {
+	}
+}
+
+static void expandChildren(TrackedBoard& tracked, const Placement* moves, const Child* children, int count,
+		const int* pieces, int plies, int chance, const DealState& dealt, bool parallel, const SearchRun& context,
+		int* values, long& candidates) {
+	/*
+		Searches the next ply below each child.
+		Serial subtrees make the child's move on the shared board and take
+		it back afterwards; parallel subtrees make it on their own copy.
+		Each task writes only its own slot, so the caller's reduction over
+		values[] is the same whatever order the tasks finish in. The best
+		value found so far is the alpha of the chance nodes below; one cut
+		there is strictly under a value a sibling reached, so it never
+		changes which child wins.
+		Parameters:
+			tracked (TrackedBoard): board the children were made on
+			moves (Placement*): placements of pieces[-1]
+			children (Child*): placements to search below
+			count (int): number of children
+			pieces (int*): known pieces left to place below the children
+			plies (int): number of known pieces left to place
+			chance (int): number of unknown pieces after them
+			dealt (DealState): pieces dealt last, for the unknown ones
+			parallel (bool): spawn a task per child
+			context (SearchRun): pool to run on and table to use
+			values (int*): out, value of each child
+			candidates (long&): running count of scored placements
+	*/
+	long counts[MAX_PLACEMENTS] = {0};
+	const Weights& weights = contextWeights(context);
+	int piece = pieces[-1];
+	atomic<int> best(NO_CUT);
+	if (parallel && context.pool && count > 1) {
+		TaskGroup group;
+		for (int i = 0; i < count; ++i) {
+			context.pool->submit(group, [&, i]() {
+				const Placement& move = moves[children[i].index];
+				TrackedBoard child = tracked;
+				TrackUndo undo;
+				int line = lineScore(children[i].numClear, weights);
+				trackLock(child, shapeMask(piece, move.rot, move.pivotX, move.pivotY), undo);
+				values[i] = line + searchNode(child, pieces, plies, chance, dealt, best.load(memory_order_relaxed) - line,
+					context, counts[i]);
+				raiseBest(best, values[i]);
+			});
+		}
+		context.pool->wait(group);
+	} else {
+		for (int i = 0; i < count; ++i) {
+			const Placement& move = moves[children[i].index];
+			TrackUndo undo;
+			int line = lineScore(children[i].numClear, weights);
+			trackLock(tracked, shapeMask(piece, move.rot, move.pivotX, move.pivotY), undo);
+			values[i] = line + searchNode(tracked, pieces, plies, chance, dealt, best.load(memory_order_relaxed) - line,
+				context, counts[i]);
+			trackUndo(tracked, undo);
+			raiseBest(best, values[i]);
+		}
+	}
+	for (int i = 0; i < count; ++i) {
+		candidates += counts[i];
+	}
+}
+
+static int chanceNode(TrackedBoard& tracked, int chance, const DealState& dealt, int alpha, const SearchRun& context,
+		long& candidates) {
+	/*
+		Expected value of a board before an unknown piece: the values the
+		model's pieces would get, averaged by their odds.
+		The first chance ply averages every piece that can come; deeper
+		ones average CHANCE_SAMPLES of them, drawn by their odds from a
+		stream seeded by the node's table key, so a node always samples
+		the same pieces. Pieces are taken in the order of the side the
+		key was made from, so a board and its mirror image, which share
+		the key, sample mirrored pieces and get the same value. Pieces are averaged one at a time (star pruning): once the
+		rest could not lift the average to alpha even if each reached
+		chanceBound, the node stops and returns that bound, which is under
+		alpha, instead of its value.
+		Parameters:
+			tracked (TrackedBoard): board before the unknown piece, left as
+				it was on return
+			chance (int): number of unknown pieces left to place
+			dealt (DealState): pieces dealt last
+			alpha (int): value to beat; NO_CUT to search the node fully
+			context (SearchRun): the search's options
+			candidates (long&): running count of scored placements
+	*/
+	const PieceModel& model = context.pieceModel;
+	int outcomes[7];
+	int64_t odds[7];
+	int count = 0;
+	int64_t total = 0;
+	bool flipped;
+	int value;
+	if (outOfTime(context)) {
+		return LOSS_SCORE;
+	}
+	uint64_t key = subtreeKey(tracked, 0, 0, chance, dealt, context, &flipped);
+	if (context.table && context.table->probe(key, value)) {
+		return value;
+	}
+	// pieces in the order of the side the key was made from
+	int order[7];
+	for (int i = 0; i < 7; ++i) {
+		order[i] = flipped ? mirrorPiece[i] : i;
+	}
+	for (int i = 0; i < 7; ++i) {
+		int piece = order[i];
+		if (dealt.gaps[piece] >= model.history && model.weights[piece] > 0) {
+			outcomes[count] = piece;
+			odds[count++] = model.weights[piece];
+		}
+	}
+	// the model gives every piece that can come no weight: take them evenly
+	if (count == 0) {
+		for (int i = 0; i < 7; ++i) {
+			if (dealt.gaps[order[i]] >= model.history) {
+				outcomes[count] = order[i];
+				odds[count++] = 1;
+			}
+		}
+	}
+	if (chance < context.firstChance && count > CHANCE_SAMPLES) {
+		// draw without replacement: pick one of the pieces left by odds,
+		// swap it to the front
+		for (int i = 0; i < CHANCE_SAMPLES; ++i) {
+			int64_t left = 0;
+			for (int j = i; j < count; ++j) {
+				left += odds[j];
+			}
+			int64_t pick = mixKey(key + i) % left;
+			int j = i;
+			while (pick >= odds[j]) {
+				pick -= odds[j++];
+			}
+			swap(outcomes[i], outcomes[j]);
+			swap(odds[i], odds[j]);
+		}
+		count = CHANCE_SAMPLES;
+	}
+	for (int i = 0; i < count; ++i) {
+		total += odds[i];
+	}
+	int bound = context.bounded ? chanceBound(tracked, chance, contextWeights(context)) : 0;
+	int64_t sum = 0;
+	int64_t left = total;
+	for (int i = 0; i < count; ++i) {
+		DealState next = dealPiece(dealt, outcomes[i], model.history);
+		sum += odds[i] * searchNode(tracked, outcomes + i, 1, chance - 1, next, NO_CUT, context, candidates);
+		left -= odds[i];
+		if (context.bounded && left > 0 && sum + left*bound < (int64_t) alpha*total) {
+			return floorDiv(sum + left*bound, total);
+		}
+	}
+	value = floorDiv(sum, total);
+	if (context.table && !cancelled(context)) {
+		context.table->store(key, value);
+	}
+	return value;
+}
+
+static int searchNode(TrackedBoard& tracked, const int* pieces, int plies, int chance, const DealState& dealt, int alpha,
+		const SearchRun& context, long& candidates) {
+	/*
+		Value of a board with pieces still to place.
+		Only the BEAM_WIDTH best placements by static score are searched
+		deeper; the rest are pruned. With no known piece left the board
+		is a chance node.
+		Parameters:
+			tracked (TrackedBoard): board before pieces[0] is placed, left
+				as it was on return
+			pieces (int*): known upcoming pieces
+			plies (int): number of known pieces left to place
+			chance (int): number of unknown pieces after them
+			dealt (DealState): pieces dealt last, for the unknown ones
+			alpha (int): passed to a chance node, see chanceNode
+			context (SearchRun): pool for deep subtrees and value table
+			candidates (long&): running count of scored placements
+		Values are cached by board hash and piece sequence, so boards
+		reached through different move orders are only searched once.
+	*/
+	Placement moves[MAX_PLACEMENTS];
+	Child children[MAX_PLACEMENTS];
+	int values[MAX_PLACEMENTS];
+	uint64_t key = 0;
+	bool flipped = false;
+	int count;
+	int best = LOSS_SCORE;
+	if (plies == 0) {
+		return chanceNode(tracked, chance, dealt, alpha, context, candidates);
+	}
+	if (outOfTime(context)) {
+		return LOSS_SCORE;
+	}
+	if (context.table) {
+		key = subtreeKey(tracked, pieces, plies, chance, dealt, context, &flipped);
+		if (context.table->probe(key, best)) {
+			return best;
+		}
+	}
+	count = contextPlacements(context, tracked, pieces[0], moves);
+	if (count == 0) {
+		return LOSS_SCORE;
+	}
+	makeChildren(tracked, pieces[0], moves, count, contextWeights(context), flipped, children);
+	candidates += count;
+	if (plies == 1 && chance == 0) {
+		for (int i = 0; i < count; ++i) {
+			if (best < children[i].score) {
+				best = children[i].score;
+			}
+		}
+		if (context.table) {
+			context.table->store(key, best);
+		}
+		return best;
+	}
+	sortChildren(children, count);
+	if (count > BEAM_WIDTH) {
+		count = BEAM_WIDTH;
+	}
+	// only subtrees deep enough to outweigh the task overhead are spawned
+	expandChildren(tracked, moves, children, count, pieces + 1, plies - 1, chance, dealt,
+		plies - 1 + chance >= PARALLEL_PLIES, context, values, candidates);
+	for (int i = 0; i < count; ++i) {
+		if (best < values[i]) {
+			best = values[i];
+		}
+	}
+	// a cancelled subtree's value is incomplete, keep it out of the table
+	if (context.table && !cancelled(context)) {
+		context.table->store(key, best);
+	}
+	return best;
+}
+
+static SearchResult searchRoot(TrackedBoard& tracked, const int* pieces, int plies, int chance, const DealState& dealt,
+		const SearchRun& context) {
+	/*
+		Best placement of pieces[0] and its value.
+		Parameters:
+			tracked (TrackedBoard): current board
+			pieces (int*): current piece followed by the preview queue
+			plies (int): number of known pieces to search
+			chance (int): number of unknown pieces after them
+			dealt (DealState): pieces dealt last, for the unknown ones
+			context (SearchRun): the search's options
+	*/
+	SearchResult result;
+	Placement moves[MAX_PLACEMENTS];
+	Child children[MAX_PLACEMENTS];
+	int values[MAX_PLACEMENTS];
+	int count = contextPlacements(context, tracked, pieces[0], moves);
+	result.found = false;
+	result.score = LOSS_SCORE;
+	result.moveInstr = 0;
+	result.candidates = count;
+	result.plies = plies;
+	result.chancePlies = 0;
+	makeChildren(tracked, pieces[0], moves, count, contextWeights(context), false, children);
+	if (plies > 1 || chance > 0) {
+		sortChildren(children, count);
+		if (count > BEAM_WIDTH) {
+			count = BEAM_WIDTH;
+		}
+		expandChildren(tracked, moves, children, count, pieces + 1, plies - 1, chance, dealt, true, context, values,
+			result.candidates);
+	} else {
+		for (int i = 0; i < count; ++i) {
+			values[i] = children[i].score;
+		}
+	}
+	// reduce in child order: the first of equal values wins
+	for (int i = 0; i < count; ++i) {
+		if (!result.found || result.score < values[i]) {
+			result.found = true;
+			result.score = values[i];
+			result.move = moves[children[i].index];
+		}
+	}
+	return result;
+}
+
+SearchResult searchMove(const Bitboard& board, const int* pieces, int plies, const SearchContext& context) {
+	/*
+		Picks the placement of pieces[0] with the best value after
+		looking ahead through the rest of the known pieces.
+		With context.budget the search is anytime: it looks one piece
+		ahead, then two, up to every known piece, then on through one
+		unknown piece (expectimax), then two, up to context.chancePlies.
+		The search that runs past the budget is abandoned and the deepest
+		finished one's move is kept; the one-piece search never reads the
+		clock, so there is always a move. Without a budget the known
+		pieces are searched once on their own, then once followed by all
+		context.chancePlies unknown pieces.
+		Parameters:
+			board (Bitboard): current board
+			pieces (int*): current piece followed by the preview queue
+			plies (int): number of pieces to search, capped at MAX_PLIES
+			context (SearchContext): optional pool, transposition table,
+				weights, expectimax settings and time budget
+	*/
+	if (context.monteCarlo) {
+		return monteCarloMove(board, pieces, plies, context);
+	}
+	SearchRun run(context);
+	TrackedBoard tracked;
+	DealState dealt = {};
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	initTracked(tracked, board);
+	// entries this decision touches count as the most recently used
+	if (context.table) {
+		context.table->age();
+	}
+	if (plies > MAX_PLIES) {
+		plies = MAX_PLIES;
+	}
+	run.timed = context.budget > 0;
+	run.deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(context.budget));
+	SearchResult result = searchRoot(tracked, pieces, run.timed ? 1 : plies, 0, dealt, run);
+	for (int depth = 2; run.timed && depth <= plies && result.found && !cancelled(run); ++depth) {
+		SearchResult deeper = searchRoot(tracked, pieces, depth, 0, dealt, run);
+		deeper.candidates += result.candidates;
+		if (cancelled(run)) {
+			result.candidates = deeper.candidates;
+		} else {
+			result = deeper;
+		}
+	}
+	int chance = min(context.chancePlies, MAX_CHANCE_PLIES);
+	if (chance > 0 && result.found && !cancelled(run)) {
+		const Weights& weights = contextWeights(context);
+		// a model that can run out of pieces to deal is not the client's
+		run.pieceModel = context.model ? *context.model : clientModel;
+		if (run.pieceModel.history < 0 || run.pieceModel.history > 6) {
+			run.pieceModel = clientModel;
+		}
+		run.modelKeys[0] = modelKey(run.pieceModel, 0);
+		run.modelKeys[1] = modelKey(run.pieceModel, mirrorPiece);
+		run.bounded = weights.flat >= 0 && weights.hole >= 0 && weights.death >= 0 && weights.pit >= 0;
+		// the pieces before pieces[0] are not known: every piece may come
+		for (int i = 0; i < 7; ++i) {
+			dealt.gaps[i] = run.pieceModel.history;
+		}
+		for (int i = 0; i < plies; ++i) {
+			dealt = dealPiece(dealt, pieces[i], run.pieceModel.history);
+		}
+		// only a budget needs the shallower depths to fall back on
+		for (int depth = run.timed ? 1 : chance; depth <= chance && !cancelled(run); ++depth) {
+			run.firstChance = depth;
+			SearchResult averaged = searchRoot(tracked, pieces, plies, depth, dealt, run);
+			result.candidates += averaged.candidates;
+			if (!cancelled(run)) {
+				result.move = averaged.move;
+				result.score = averaged.score;
+				result.chancePlies = depth;
+			}
+		}
+	}
+	// reachable placements are sent as paths, not moveInstr
+	if (result.found && !context.reachable) {
+		result.moveInstr = encodeMove(result.move);
+	}
+	return result;
+}
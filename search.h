@@ -0,0 +1,102 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <atomic>
+
+#include "bitboard.h"
+#include "evaluate.h"
+
+class ThreadPool;
+class TranspositionTable;
+
+// search limits
+#define MAX_PLIES 4	// deepest lookahead, including the current piece
+#define BEAM_WIDTH 8	// placements per ply expanded to the next ply
+#define PARALLEL_PLIES 2	// shallowest subtree worth a pool task
+// one per (canonical rotation, x, y) a piece can rest at, so no board can
+// have more; turn-shift-drops need 34, reachable placements rarely pass 50
+#define MAX_PLACEMENTS (4 * BOARD_WIDTH * BOARD_HEIGHT)
+#define LOSS_SCORE -1000000	// value of a board the next piece cannot spawn on
+#define MAX_CHANCE_PLIES 3	// deepest expectimax lookahead past the known pieces
+#define CHANCE_SAMPLES 3	// pieces averaged at a chance node below the first
+
+// where a piece locks; turns and shift are the turn-shift-drop instruction
+// that reaches it, for placements from generatePlacements
+struct Placement {
+	int rot;	// final rotation index
+	int pivotX;	// final pivot position
+	int pivotY;
+	int turns;	// clockwise turns sent to the client
+	int shift;	// columns moved after turning (+ right, - left)
+};
+
+// odds of the pieces an expectimax search has not been shown, the way the
+// client's getNext deals them: a piece dealt in the last history draws
+// cannot come, the others come in proportion to their weights
+struct PieceModel {
+	int history;
+	int weights[7];
+};
+
+// getNext: no repeat within 3 draws, the other pieces equally likely
+extern const PieceModel clientModel;
+
+// shared resources a search may use; all are optional
+struct SearchContext {
+	ThreadPool* pool;	// spreads subtrees over threads
+	TranspositionTable* table;	// caches evaluations and subtree values
+	const Weights* weights;	// evaluation weights, defaultWeights if null
+	const std::atomic<bool>* cancel;	// set to abandon the search; its result is then meaningless
+	bool reachable;	// search every reachable placement (generateReachable), not only turn-shift-drops
+	// share table entries between mirror images, the pieces mirrored to
+	// match (J and L, S and Z); only low stacks are mirrored, see subtreeKey
+	bool mirrored;
+	// expectimax: unknown pieces to average over after the known ones, at
+	// most MAX_CHANCE_PLIES; 0 stops at the end of the preview
+	int chancePlies;
+	const PieceModel* model;	// odds of the unknown pieces, clientModel if null
+	// seconds a decision may take: the search deepens one piece at a time,
+	// known pieces first and then unknown ones, and the deepest search
+	// finished in time gives the move; a Monte Carlo search runs until
+	// then; 0 for no limit
+	double budget;
+	// Monte Carlo tree search (montecarlo.h) in place of the beam search
+	bool monteCarlo;
+};
+
+struct SearchResult {
+	bool found;	// false if the piece cannot spawn
+	Placement move;
+	int score;
+	int moveInstr;	// move encoded for the 'A' reply
+	long candidates;	// placements scored
+	int plies;	// known pieces the move looked through; fewer than asked if it ran out of time
+	// unknown pieces the move averaged over; 0 without expectimax, or if it
+	// ran out of time
+	int chancePlies;
+};
+
+// every distinct turn-shift-drop placement of a piece, returns the count
+// tops is the board's columnTops, worked out here if null
+int generatePlacements(const Bitboard& board, int piece, Placement* out, const int8_t* tops = 0);
+
+// static score (the evaluation plus lineScore) and lines cleared of each
+// placement of piece; tracked is left as it was
+void scorePlacements(TrackedBoard& tracked, int piece, const Placement* moves, int count, const Weights& weights,
+	int* scores, int* numClear);
+
+// tens = horizontal shift (+-, 9 for none); ones = rotation
+int encodeMove(const Placement& move);
+
+// what a table's values depend on besides the positions: the weights and
+// the search limits; a table saved under another tag cannot be reused
+uint64_t tableTag(const Weights& weights);
+
+// best placement of pieces[0], looking ahead through pieces[1..plies-1]
+// and then context.chancePlies unknown pieces
+// the result does not depend on the number of threads in context.pool,
+// nor, without a budget, on timing; with context.monteCarlo it is
+// monteCarloMove's instead
+SearchResult searchMove(const Bitboard& board, const int* pieces, int plies, const SearchContext& context = SearchContext());
+
+#endif
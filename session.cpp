@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "logger.h"
+#include "session.h"
+
+using namespace std;
+
+void initSession(Session& session, int id, const SearchContext& context) {
+	session.id = id;
+	resetGame(session.game);
+	session.linkVersion = FRAME_VERSION;
+	session.context = context;
+	session.context.reachable = false;
+	session.budget = context.budget;
+	session.level = -1;
+	session.pathLength = 0;
+}
+
+// reads the preview queue, one piece index per byte or per digit
+static void readPreview(GameState& game, const uint8_t* pieces, int count, bool digits) {
+	game.numPreview = 0;
+	for (int i = 0; i < count && game.numPreview < MAX_PLIES; ++i) {
+		int piece = digits ? pieces[i] - '0' : pieces[i];
+		if (piece >= 0 && piece <= 6) {
+			game.preview[game.numPreview++] = piece;
+		}
+	}
+}
+
+// "C x y x y x y x y rot", or the binary frame; false, with the game left
+// as it was, if the tiles are not a piece that fits on the board
+static bool readPiece(GameState& game, const string& line, const Message& message) {
+	int cells[4][2];
+	int rot;
+	if (message.binary) {
+		for (int i = 0; i < 4; ++i) {
+			cells[i][0] = message.payload[2*i];
+			cells[i][1] = message.payload[2*i + 1];
+		}
+		rot = message.payload[8];
+	} else {
+		istringstream fields(line.substr(1));
+		for (int i = 0; i < 4; ++i) {
+			fields >> cells[i][0] >> cells[i][1];
+		}
+		if (!(fields >> rot)) {
+			return false;
+		}
+	}
+	if (!validPiece(game, cells, rot)) {
+		return false;
+	}
+	for (int i = 0; i < 4; ++i) {
+		game.currentPiece[i][0] = cells[i][0];
+		game.currentPiece[i][1] = cells[i][1];
+	}
+	game.currentRotIndex = rot;
+	return true;
+}
+
+MessageAction readMessage(Session& session, const string& line, Message& message) {
+	/*
+		Decodes a binary frame or ASCII line and applies it to the session's
+		game, the way the serial server always has.
+		Parameters:
+			session (Session): client the line came from
+			line (string): the message without its line ending
+			message (Message): out, the decoded message
+		Returns what to do next; messages that cannot be read are logged and
+		dropped without a reply.
+	*/
+	GameState& game = session.game;
+	if (line.empty()) {
+		return ACTION_NONE;
+	}
+	message.binary = (uint8_t) line[0] == FRAME_MAGIC;
+	message.type = line[0];
+	message.length = 0;
+	message.resumeId = -1;
+	if (message.binary) {
+		message.length = decodeFrame((const uint8_t*) line.data(), line.size(), session.linkVersion, message.type, message.payload);
+		// a damaged or truncated frame is dropped without a reply
+		if (message.length < 0 || (message.type == 'I' && message.length != PACKED_BOARD)
+			|| (message.type == 'C' && message.length != PACKED_PIECE)) {
+			LOG(LOG_WARN, "session %d: bad frame", session.id);
+			return ACTION_NONE;
+		}
+	}
+	switch (message.type) {
+	case 'V': {
+		// framing handshake: "V <client version> [<session>]", answered with
+		// the highest version both ends know
+		istringstream fields(line.substr(1));
+		int version = FRAME_VERSION;
+		fields >> version;
+		message.version = min(max(version, 0), FRAME_VERSION);
+		if (!(fields >> message.resumeId)) {
+			message.resumeId = -1;
+		}
+		return ACTION_HANDSHAKE;
+	}
+	case 'I':
+		if (!message.binary && line.size() < 202) {
+			LOG(LOG_WARN, "session %d: short board", session.id);
+			return ACTION_NONE;
+		}
+		clearBoard(game.tiles);
+		for (int i = 0; i < 200; ++i) {
+			if (message.binary ? packedCell(message.payload, i) : line[2+i] != '0') {
+				setCell(game.tiles, i%10, i/10);
+			}
+		}
+		return ACTION_ACK;
+	case 'C':
+		if (!readPiece(game, line, message)) {
+			LOG(LOG_WARN, "session %d: bad piece", session.id);
+			return ACTION_NONE;
+		}
+		// drop the first piece like a rock
+		dropPiece(game);
+		lockRealPiece(game);
+		game.moveInstr = 0;
+		game.pieceNum = -1;
+		return ACTION_ACK;
+	case 'R':
+		// the preview queue: "R <next> [<next> ...]" or one byte each
+		if (message.binary) {
+			readPreview(game, message.payload, message.length, false);
+		} else {
+			readPreview(game, (const uint8_t*) line.data() + 1, line.size() - 1, true);
+		}
+		session.context.reachable = false;
+		return ACTION_MOVE;
+	case 'L': {
+		if (!message.binary) {
+			return ACTION_NONE;
+		}
+		// lock event: the client's lock replaces the server's guess
+		const uint8_t* payload = message.payload;
+		int tileCount = message.length > 0 ? payload[0] : -1;
+		int index = 1 + 2*tileCount;
+		// piece, checksum and, from version 4, the level
+		int fixed = session.linkVersion >= 4 ? 4 : 3;
+		// a piece index past 6 is a bad frame, not a board that drifted: a
+		// resync would only bring the same frame back
+		if ((tileCount != 0 && tileCount != 4) || message.length < index + fixed || payload[index] > 6) {
+			LOG(LOG_WARN, "session %d: bad lock event", session.id);
+			return ACTION_NONE;
+		}
+		if (tileCount == 4) {
+			int cells[4][2];
+			for (int i = 0; i < 4; ++i) {
+				cells[i][0] = payload[1 + 2*i];
+				cells[i][1] = payload[2 + 2*i];
+			}
+			// tiles that are not a piece on free cells cannot be locked:
+			// the boards have drifted apart, or the frame is bogus
+			if (!validPiece(game, cells, -1)) {
+				LOG(LOG_WARN, "session %d: lock event tiles are not a piece on the board", session.id);
+				return ACTION_RESYNC;
+			}
+			for (int i = 0; i < 4; ++i) {
+				game.currentPiece[i][0] = cells[i][0];
+				game.currentPiece[i][1] = cells[i][1];
+			}
+			lockRealPiece(game);
+		}
+		game.pieceNum = payload[index];
+		uint16_t checksum = (payload[index + 1] << 8) | payload[index + 2];
+		if (fixed == 4) {
+			session.level = payload[index + 3];
+		}
+		readPreview(game, payload + index + fixed, message.length - index - fixed, false);
+		if (checksum != tilesChecksum(game.tiles)) {
+			// the boards have drifted apart: ask for the client's
+			return ACTION_RESYNC;
+		}
+		// version 3 clients play paths, so every reachable placement counts
+		session.context.reachable = session.linkVersion >= 3;
+		// a client that reports its level gets its answer before the piece
+		// falls to the stack, however deep the search could have gone
+		if (session.level >= 0) {
+			session.context.budget = gravityBudget(game.tiles, game.pieceNum, session.level, session.budget);
+		}
+		return ACTION_MOVE;
+	}
+	case 'X':
+		return ACTION_QUIT;
+	}
+	return ACTION_NONE;
+}
+
+bool needsDecision(const Session& session, const Message& message) {
+	// the piece from the last 'R' is the one the client plays now; after a
+	// 'C' that piece was already dropped, so the move is 0
+	return message.type == 'L' || (message.type == 'R' && session.game.pieceNum != -1);
+}
+
+void findMovePath(Session& session) {
+	// a piece that cannot spawn gets an empty path: the game is over
+	session.pathLength = 0;
+	const GameState& game = session.game;
+	if (session.context.reachable && game.lastResult.found) {
+		session.pathLength = max(0, findPath(game.tiles, game.pieceNum, game.lastResult.move, session.movePath));
+	}
+}
+
+void decideSession(Session& session) {
+	calculateMove(session.game, session.context);
+	findMovePath(session);
+}
+
+// one binary frame and the newline the client reads up to
+static string frameLine(const Session& session, char type, const uint8_t* payload, int length) {
+	uint8_t wire[MAX_WIRE_FRAME];
+	int size = encodeFrame(session.linkVersion, type, payload, length, wire);
+	return string((const char*) wire, size) + "\n";
+}
+
+string encodeReply(const Session& session, const Message& message, MessageAction action) {
+	/*
+		Builds the reply in the format the message came in.
+		Parameters:
+			session (Session): client to answer
+			message (Message): message being answered
+			action (MessageAction): what readMessage made of it
+		Returns the bytes to write, empty if the message gets no reply.
+	*/
+	uint8_t moveInstr = (uint8_t) session.game.moveInstr;
+	switch (action) {
+	case ACTION_HANDSHAKE:
+		// clients read the version and ignore the rest of the line
+		return "A " + to_string(message.version) + " " + to_string(session.id) + "\n";
+	case ACTION_ACK:
+		return message.binary ? frameLine(session, 'A', 0, 0) : "A\n";
+	case ACTION_MOVE:
+		if (message.type == 'L' && session.context.reachable) {
+			return frameLine(session, 'P', session.movePath, session.pathLength);
+		}
+		return message.binary ? frameLine(session, 'A', &moveInstr, 1) : "A " + to_string(session.game.moveInstr) + "\n";
+	case ACTION_RESYNC:
+		return frameLine(session, 'S', 0, 0);
+	default:
+		return "";
+	}
+}
+
+void logReply(const Session& session, const Message& message, MessageAction action, bool decided, bool precomputed) {
+	const SearchResult& result = session.game.lastResult;
+	const char* source = precomputed ? " (precomputed)" : "";
+	if (action == ACTION_HANDSHAKE) {
+		LOG(LOG_INFO, "session %d: A %d", session.id, message.version);
+	} else if (action == ACTION_ACK) {
+		LOG(LOG_DEBUG, "session %d: A", session.id);
+	} else if (action == ACTION_RESYNC) {
+		LOG(LOG_WARN, "session %d: board checksum mismatch, S", session.id);
+	} else if (action == ACTION_MOVE && decided) {
+		if (message.type == 'L' && session.context.reachable) {
+			LOG(LOG_INFO, "session %d: path of %d inputs to rot %d at %d,%d score: %d candidates: %ld%s", session.id,
+				session.pathLength, result.move.rot, result.move.pivotX, result.move.pivotY, result.score,
+				result.candidates, source);
+		} else {
+			LOG(LOG_INFO, "session %d: move %d score: %d candidates: %ld%s", session.id, session.game.moveInstr,
+				result.score, result.candidates, source);
+		}
+	}
+}
+
+void finishMessage(Session& session, const Message& message) {
+	GameState& game = session.game;
+	// 'L' has no applyMove: the next lock event says where the piece went
+	if (message.type == 'R') {
+		if (game.pieceNum != -1) {
+			applyMove(game);
+		}
+		game.pieceNum = (game.numPreview > 0) ? game.preview[0] : -1;
+	}
+}
+
+uint16_t tilesChecksum(const Bitboard& tiles) {
+	uint8_t packed[PACKED_BOARD] = {0};
+	for (int i = 0; i < 200; ++i) {
+		if (getCell(tiles, i%10, i/10)) {
+			setPackedCell(packed, i);
+		}
+	}
+	return boardChecksum(packed);
+}
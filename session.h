@@ -0,0 +1,68 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <string>
+#include <stdint.h>
+
+#include "frame.h"
+#include "game.h"
+#include "reachability.h"
+
+// one client's side of the protocol: its game, its link and the decoding
+// of its messages; the serial server runs one session, the host one per
+// connection
+
+// what the server does with a message once it is read into the session
+enum MessageAction {
+	ACTION_NONE,	// dropped: empty line, damaged frame or unknown type
+	ACTION_HANDSHAKE,	// 'V': reply with the agreed version and the session ID
+	ACTION_ACK,	// 'I', 'C': plain acknowledgement
+	ACTION_MOVE,	// 'R', 'L': decide if needsDecision, then reply with the move
+	ACTION_RESYNC,	// 'L' whose checksum does not match: reply 'S'
+	ACTION_QUIT	// 'X'
+};
+
+// one message as it arrived
+struct Message {
+	char type;
+	bool binary;	// a frame; the reply uses the same format
+	int length;	// payload bytes, frames only
+	uint8_t payload[MAX_PAYLOAD];
+	int version;	// 'V': version agreed with the client
+	int resumeId;	// 'V': session the client asks to rejoin, -1 if none
+};
+
+struct Session {
+	int id;	// announced in the handshake reply
+	GameState game;
+	int linkVersion;	// frame version of the last binary message
+	// shared workers, table and weights; reachable and budget are this
+	// client's own
+	SearchContext context;
+	double budget;	// the server's budget, the most any decision may take
+	int level;	// from the last version 4 'L', -1 if the client never sent one
+	// inputs that reach game.lastResult.move, for 'P' replies
+	uint8_t movePath[MAX_PATH];
+	int pathLength;
+};
+
+void initSession(Session& session, int id, const SearchContext& context);
+// decodes one line, without its ending, and applies it to the session
+MessageAction readMessage(Session& session, const std::string& line, Message& message);
+// true if the reply to message carries a move that has to be searched
+bool needsDecision(const Session& session, const Message& message);
+// path to game.lastResult.move when the client plays paths
+void findMovePath(Session& session);
+// searches the move and its path without any speculation
+void decideSession(Session& session);
+// the reply to message, line ending included
+std::string encodeReply(const Session& session, const Message& message, MessageAction action);
+// logs what the reply said
+void logReply(const Session& session, const Message& message, MessageAction action, bool decided, bool precomputed);
+// advances the game past the reply: after an 'R' the move is played and
+// the first preview piece comes next
+void finishMessage(Session& session, const Message& message);
+// checksum of the server's board, computed the way the client does
+uint16_t tilesChecksum(const Bitboard& tiles);
+
+#endif
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "game.h"
+#include "pieceGen.h"
+#include "threadPool.h"
+#include "transposition.h"
+
+using namespace std;
+
+// transposition table size: 2^20 slots of 16 bytes
+#define TABLE_BITS 20
+
+// games and their pieces run until a piece cannot spawn or this many
+// pieces have been placed
+#define DEFAULT_MAX_PIECES 10000
+
+// totals over every game played
+struct SimStats {
+	long games;
+	long pieces;
+	long decisions;	// calculateMove calls, including the one that tops out
+	long averaged;	// decisions that averaged over at least one unknown piece
+	long plies;	// known pieces looked through, summed over decisions
+	long lines;
+	long candidates;
+	double seconds;	// wall time of the whole run
+	double searchSeconds;	// time spent in calculateMove
+};
+
+static double elapsed(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void playGame(const SearchContext& context, uint64_t seed, int previewLength, long maxPieces, int level,
+		SimStats& stats) {
+	/*
+		Plays one game against a seeded piece sequence the same way the
+		server plays against the client: each decision sees the piece in
+		play plus previewLength upcoming pieces.
+		Parameters:
+			context (SearchContext): workers, table and weights to search with
+			seed (uint64_t): piece sequence seed
+			previewLength (int): upcoming pieces the AI is shown
+			maxPieces (long): stop after this many pieces
+			level (int): level the game starts at, raised every 10 lines;
+				each decision then gets gravityBudget, the way the server
+				times a version 4 client; -1 for context.budget throughout
+			stats (SimStats): totals to add this game to
+	*/
+	GameState game;
+	SearchContext decision = context;
+	PieceGenerator gen;
+	int queue[MAX_PLIES];
+	long pieces = 0;
+	long lines = 0;
+	seedGenerator(gen, seed);
+	resetGame(game);
+	for (int i = 0; i <= previewLength; ++i) {
+		queue[i] = nextPiece(gen);
+	}
+	while (pieces < maxPieces) {
+		game.pieceNum = queue[0];
+		game.numPreview = previewLength;
+		for (int i = 0; i < previewLength; ++i) {
+			game.preview[i] = queue[i + 1];
+		}
+		if (level >= 0) {
+			decision.budget = gravityBudget(game.tiles, game.pieceNum, level + lines/10, context.budget);
+		}
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool alive = calculateMove(game, decision);
+		stats.searchSeconds += elapsed(start);
+		stats.decisions++;
+		if (game.lastResult.chancePlies > 0) {
+			stats.averaged++;
+		}
+		stats.candidates += game.lastResult.candidates;
+		stats.plies += game.lastResult.plies;
+		if (!alive) {
+			break;
+		}
+		lines += applyMove(game);
+		pieces++;
+		for (int i = 0; i < previewLength; ++i) {
+			queue[i] = queue[i + 1];
+		}
+		queue[previewLength] = nextPiece(gen);
+	}
+	cout << "game " << stats.games << " (seed " << seed << "): " << pieces << " pieces, " << lines << " lines"
+		<< (pieces < maxPieces ? ", topped out" : "") << endl;
+	stats.games++;
+	stats.pieces += pieces;
+	stats.lines += lines;
+}
+
+int main(int argc, char* argv[]) {
+	/*
+		Headless self-play benchmark: plays the server AI against seeded
+		piece sequences at full speed, no serial port needed.
+		Usage: simulator [-e chancePlies] [-b budget] [-g level] [-m] [games] [seed] [preview] [threads] [maxPieces]
+				[weightsFile]
+			chancePlies: unknown pieces past the preview to average over
+				(expectimax), default 0
+			budget: milliseconds a decision may take, the deepest search
+				finished by then gives the move; 0 (the default) for no
+				limit; with -m, the time each decision's Monte Carlo
+				tree search runs
+			level: play at the client's gravity from this level on, so
+				every decision gets gravityBudget (at most budget)
+			-m: Monte Carlo tree search instead of the beam search
+			games: number of games, default 10
+			seed: seed of the first game, game i uses seed + i, default 1
+			preview: upcoming pieces shown to the AI, default 1 (the
+				client's NEXT box), at most MAX_PLIES - 1
+			threads: search threads, 0 for one per core, default 0
+			maxPieces: pieces per game before it is called, default 10000
+			weightsFile: evaluation weights, the compiled-in defaults if
+				omitted
+	*/
+	int chancePlies = 0;
+	double budget = 0;
+	int level = -1;
+	bool monteCarlo = false;
+	// positional arguments, options taken out
+	char* args[7] = {argv[0]};
+	int numArgs = 1;
+	for (int i = 1; i < argc; ++i) {
+		string option = argv[i];
+		if (option == "-e" && i + 1 < argc) {
+			chancePlies = atoi(argv[++i]);
+		} else if (option == "-b" && i + 1 < argc) {
+			budget = atof(argv[++i]) / 1000;
+		} else if (option == "-g" && i + 1 < argc) {
+			level = max(0, atoi(argv[++i]));
+		} else if (option == "-m") {
+			monteCarlo = true;
+		} else if (numArgs < 7) {
+			args[numArgs++] = argv[i];
+		}
+	}
+	int games = numArgs > 1 ? atoi(args[1]) : 10;
+	uint64_t seed = numArgs > 2 ? strtoull(args[2], 0, 10) : 1;
+	int previewLength = numArgs > 3 ? atoi(args[3]) : 1;
+	int threads = numArgs > 4 ? atoi(args[4]) : 0;
+	long maxPieces = numArgs > 5 ? atol(args[5]) : DEFAULT_MAX_PIECES;
+	Weights weights = defaultWeights;
+	if (numArgs > 6 && !loadWeights(args[6], weights)) {
+		return 1;
+	}
+	if (previewLength < 0) {
+		previewLength = 0;
+	}
+	if (previewLength > MAX_PLIES - 1) {
+		previewLength = MAX_PLIES - 1;
+	}
+	ThreadPool pool(threads);
+	TranspositionTable table(TABLE_BITS);
+	SearchContext context = {&pool, &table, &weights, 0, false, false, chancePlies, 0, budget, monteCarlo};
+	cout << "evaluator: " << evaluatorName() << ", threads: " << pool.size() << ", preview: " << previewLength
+		<< ", chance plies: " << chancePlies << (monteCarlo ? ", Monte Carlo" : "") << endl;
+
+	SimStats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < games; ++i) {
+		// every game starts cold so results do not depend on game order
+		table.clear();
+		playGame(context, seed + i, previewLength, maxPieces, level, stats);
+	}
+	stats.seconds = elapsed(start);
+
+	cout << "games: " << stats.games << ", pieces: " << stats.pieces << ", lines: " << stats.lines << endl;
+	if (stats.games > 0) {
+		cout << "mean game length: " << (double) stats.pieces / stats.games << " pieces, mean lines: "
+			<< (double) stats.lines / stats.games << endl;
+	}
+	if (chancePlies > 0) {
+		cout << "expectimax decisions: " << stats.averaged << " of " << stats.decisions << endl;
+	}
+	if ((budget > 0 || level >= 0) && stats.decisions > 0) {
+		cout << "mean lookahead: " << (double) stats.plies / stats.decisions << " known pieces" << endl;
+	}
+	cout << "time: " << stats.seconds << " s (search " << stats.searchSeconds << " s)" << endl;
+	if (stats.seconds > 0 && stats.searchSeconds > 0) {
+		cout << "pieces/sec: " << stats.pieces / stats.seconds << endl;
+		cout << "decisions/sec: " << stats.decisions / stats.searchSeconds << endl;
+		cout << "candidates/sec: " << stats.candidates / stats.searchSeconds << endl;
+	}
+	return 0;
+}
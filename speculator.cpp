@@ -0,0 +1,169 @@
+#include <cstring>
+
+#include "speculator.h"
+
+using namespace std;
+
+Speculator::Speculator(const SearchContext& searchContext) : context(searchContext), abortSearch(false),
+		stopping(false), active(false), generation(0), numKnown(0), running(-1), wanted(-1),
+		numHits(0), numMisses(0) {
+	context.cancel = &abortSearch;
+	worker = thread(&Speculator::run, this);
+}
+
+Speculator::~Speculator() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+		abortSearch = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+void Speculator::start(const Bitboard& newBoard, const int* newKnown, int count) {
+	/*
+		Sets up a new run.
+		Parameters:
+			newBoard (Bitboard): board the next decision will be made on
+			newKnown (int*): pieces already known for that decision, the
+				piece in play first
+			count (int): number of known pieces, at most MAX_PLIES - 1
+	*/
+	lock_guard<mutex> guard(lock);
+	stopLocked();
+	board = newBoard;
+	numKnown = count;
+	for (int i = 0; i < count; ++i) {
+		known[i] = newKnown[i];
+	}
+	for (int i = 0; i < 7; ++i) {
+		done[i] = false;
+	}
+	active = true;
+	changed.notify_all();
+}
+
+bool Speculator::take(const Bitboard& actual, const int* pieces, int count, SearchResult& result) {
+	/*
+		Answers a decision from the current run.
+		Parameters:
+			actual (Bitboard): board the decision is made on
+			pieces (int*): piece in play followed by the preview queue
+			count (int): number of pieces
+			result (SearchResult): out, the search result if it matches
+	*/
+	unique_lock<mutex> guard(lock);
+	bool matches = active && count == numKnown + 1 && pieces[count - 1] >= 0 && pieces[count - 1] < 7
+		&& memcmp(actual.rows, board.rows, sizeof(board.rows)) == 0;
+	for (int i = 0; i < numKnown && matches; ++i) {
+		matches = pieces[i] == known[i];
+	}
+	if (!matches) {
+		stopLocked();
+		numMisses++;
+		return false;
+	}
+	int piece = pieces[count - 1];
+	// run this piece next and drop whatever else is running
+	wanted = piece;
+	if (running >= 0 && running != piece) {
+		abortSearch = true;
+	}
+	changed.notify_all();
+	changed.wait(guard, [&]() {
+		return done[piece];
+	});
+	result = results[piece];
+	stopLocked();
+	numHits++;
+	return true;
+}
+
+void Speculator::cancel() {
+	lock_guard<mutex> guard(lock);
+	stopLocked();
+}
+
+void Speculator::setContext(const SearchContext& newContext) {
+	lock_guard<mutex> guard(lock);
+	stopLocked();
+	context = newContext;
+	context.cancel = &abortSearch;
+}
+
+long Speculator::hits() const {
+	return numHits;
+}
+
+long Speculator::misses() const {
+	return numMisses;
+}
+
+// drops the current run; the caller holds the lock
+void Speculator::stopLocked() {
+	active = false;
+	wanted = -1;
+	generation++;
+	if (running >= 0) {
+		abortSearch = true;
+	}
+}
+
+// piece to search next: the one take() waits for, else the first one not
+// done, pieces just dealt last (the client never deals them again
+// straight away); -1 if there is nothing to do
+int Speculator::nextPiece() const {
+	if (!active) {
+		return -1;
+	}
+	if (wanted >= 0) {
+		return done[wanted] ? -1 : wanted;
+	}
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int piece = 0; piece < 7; ++piece) {
+			bool recent = false;
+			for (int i = 0; i < numKnown; ++i) {
+				recent = recent || known[i] == piece;
+			}
+			if (!done[piece] && recent == (pass == 1)) {
+				return piece;
+			}
+		}
+	}
+	return -1;
+}
+
+void Speculator::run() {
+	unique_lock<mutex> guard(lock);
+	while (true) {
+		changed.wait(guard, [&]() {
+			return stopping || nextPiece() >= 0;
+		});
+		if (stopping) {
+			return;
+		}
+		int piece = nextPiece();
+		long job = generation;
+		Bitboard searchBoard = board;
+		int pieces[MAX_PLIES];
+		int count = numKnown + 1;
+		for (int i = 0; i < numKnown; ++i) {
+			pieces[i] = known[i];
+		}
+		pieces[numKnown] = piece;
+		SearchContext searchContext = context;
+		running = piece;
+		abortSearch = false;
+		guard.unlock();
+		SearchResult result = searchMove(searchBoard, pieces, count, searchContext);
+		guard.lock();
+		running = -1;
+		// a result from a dropped run or an abandoned search is thrown away
+		if (job == generation && !abortSearch) {
+			results[piece] = result;
+			done[piece] = true;
+		}
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef SPECULATOR_H
+#define SPECULATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "search.h"
+
+// searches the next decision ahead of time, once for every piece the next
+// message could add to the preview queue, while the server waits for it
+// a background thread runs the searches on the shared pool; take() hands
+// out the one that matches the message and abandons the rest
+class Speculator {
+public:
+	explicit Speculator(const SearchContext& context);
+	~Speculator();
+
+	// starts searching board for pieces known[0..numKnown-1] followed by
+	// each of the 7 pieces; replaces (and cancels) any earlier run
+	void start(const Bitboard& board, const int* known, int numKnown);
+	// result of the search for pieces on board, waiting for it if it is
+	// still running; false if no speculative search matches
+	bool take(const Bitboard& board, const int* pieces, int count, SearchResult& result);
+	// abandons the current run, e.g. when the board changes unexpectedly
+	void cancel();
+	// searches with newContext from the next run on; abandons the current one
+	void setContext(const SearchContext& newContext);
+
+	long hits() const;
+	long misses() const;
+
+private:
+	int nextPiece() const;
+	void stopLocked();
+	void run();
+
+	SearchContext context;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::atomic<bool> abortSearch;
+	bool stopping;
+	bool active;	// a run is set up and not yet taken
+	long generation;	// bumped whenever the run is replaced or dropped
+	Bitboard board;
+	int known[MAX_PLIES];
+	int numKnown;
+	bool done[7];
+	SearchResult results[7];
+	int running;	// piece being searched, -1 if none
+	int wanted;	// piece take() is waiting for, -1 if none
+	long numHits;
+	long numMisses;
+	std::thread worker;
+};
+
+#endif
@@ -14,6 +14,9 @@
 #include <string.h>
 
 #include <TouchScreen.h>
+
+#include "rotationData.h"
+#include "frame.h"
 using namespace std;
 
 #define JOY_CENTER	 512
@@ -55,13 +58,6 @@ int level = 0;
 int linesCleared = 0;
 unsigned long speedUp = 800;
 
-// offset vars
-int offTotalX, offTotalY;
-
-// rotation data
-short JLSTZoffset[5][4];
-short Ioffset[5][4];
-
 // block setup: block coordinates represent relative position
 // of each block in the tetromino, wrt the previous position.
 // base block is the tile at [4][20] on the play field
@@ -76,7 +72,6 @@ const int tetromino[7][4] = {{5, 4, 6, 7},	// I
 														 {6, 2, 1, 7}};	// Z
 // current tile
 int currentPiece[4][2];
-int beforeRot[4][2];
 int currentColour;
 int currentRotIndex = 0;
 bool activePiece = false;
@@ -86,6 +81,16 @@ int aiLock = 0;
 int shiftLock = 0; 
 int rotLock = 0;
 unsigned long fallTimer = millis();
+// frame version agreed with the server, 0 for the ASCII protocol
+int linkVersion = 0;
+// tiles of the last locked piece, not yet reported to the server
+int lastLock[4][2];
+bool lockPending = false;
+// inputs of the last 'P' reply, -1 while playing moveInstr instead
+uint8_t movePath[MAX_PAYLOAD];
+int pathLength = -1;
+// 50 ms reads to wait for the framing handshake before falling back to ASCII
+#define NEGOTIATE_TRIES 10
 
 
 // setup
@@ -102,60 +107,6 @@ void setup() {
 	pinMode(CLOCKWISE_BUTTON, INPUT_PULLUP);
 	pinMode(COUNTER_BUTTON, INPUT_PULLUP);
 
-	// rotation matrix data
-	// storage legend - x -> 0s digit, y -> 10s digit
-	// -2 -> 1, -1 -> 2, 0 -> 3, 1 -> 4, 2 -> 5
-	JLSTZoffset[0][0] = 33;
-	JLSTZoffset[0][1] = 33;
-	JLSTZoffset[0][2] = 33;
-	JLSTZoffset[0][3] = 33;
-
-	JLSTZoffset[1][0] = 33;
-	JLSTZoffset[1][1] = 43;
-	JLSTZoffset[1][2] = 33;
-	JLSTZoffset[1][3] = 23;
-
-	JLSTZoffset[2][0] = 33;
-	JLSTZoffset[2][1] = 42;
-	JLSTZoffset[2][2] = 33;
-	JLSTZoffset[2][3] = 22;
-
-	JLSTZoffset[3][0] = 33;
-	JLSTZoffset[3][1] = 35;
-	JLSTZoffset[3][2] = 33;
-	JLSTZoffset[3][3] = 35;
-
-	JLSTZoffset[4][0] = 33;
-	JLSTZoffset[4][1] = 45;
-	JLSTZoffset[4][2] = 33;
-	JLSTZoffset[4][3] = 25;
-
-	// I piece data
-	Ioffset[0][0] = 33;
-	Ioffset[0][1] = 23;
-	Ioffset[0][2] = 24;
-	Ioffset[0][3] = 34;
-
-	Ioffset[1][0] = 23;
-	Ioffset[1][1] = 33;
-	Ioffset[1][2] = 44;
-	Ioffset[1][3] = 34;
-
-	Ioffset[2][0] = 53;
-	Ioffset[2][1] = 33;
-	Ioffset[2][2] = 14;
-	Ioffset[2][3] = 34;
-
-	Ioffset[3][0] = 23;
-	Ioffset[3][1] = 34;
-	Ioffset[3][2] = 43;
-	Ioffset[3][3] = 32;
-
-	Ioffset[4][0] = 53;
-	Ioffset[4][1] = 31;
-	Ioffset[4][2] = 13;
-	Ioffset[4][3] = 35;
-	
 	// tft display initialization
 	uint16_t ID = tft.readID();
 	tft.begin(ID);
@@ -164,6 +115,107 @@ void setup() {
 	tft.drawLine(241, 0, 241, 480, colors[8]);
 }
 
+// sends one binary frame, ended by the newline the server reads up to
+// type & payload input, void return
+void sendFrame(char type, const uint8_t* payload, int length) {
+	uint8_t wire[MAX_WIRE_FRAME];
+	int size = encodeFrame(linkVersion, type, payload, length, wire);
+	Serial.write(wire, size);
+	Serial.write('\n');
+}
+
+// reads one binary frame, waiting up to 50 ms
+// outputs type & payload, returns payload length or -1 for nothing/damaged
+int readFrame(char& type, uint8_t* payload) {
+	uint8_t wire[MAX_WIRE_FRAME];
+	Serial.setTimeout(50);
+	int size = Serial.readBytesUntil('\n', wire, MAX_WIRE_FRAME);
+	if (size <= 0) {
+		return -1;
+	}
+	int version;
+	return decodeFrame(wire, size, version, type, payload);
+}
+
+// asks the server for binary frames; an older server never answers, and
+// the client stays on the ASCII protocol
+// void input, void return
+void negotiateFraming() {
+	String strTemp;
+	linkVersion = 0;
+	Serial.println("V " + String(FRAME_VERSION));
+	for (int i = 0; i < NEGOTIATE_TRIES; ++i) {
+		Serial.setTimeout(50);
+		strTemp = Serial.readString();
+		if (strTemp[0] == 'A') {
+			int version = strTemp.substring(2).toInt();
+			if (version >= 1 && version <= FRAME_VERSION) {
+				linkVersion = version;
+			}
+			return;
+		}
+	}
+}
+
+// packs the locked tiles one bit per cell
+// output: packed board array, void return
+void packTiles(uint8_t* packed) {
+	for (int i = 0; i < PACKED_BOARD; ++i) {
+		packed[i] = 0;
+	}
+	for (int i = 0; i < 200; ++i) {
+		if (tiles[i%10][i/10] != 0) {
+			setPackedCell(packed, i);
+		}
+	}
+}
+
+// sends the whole board and waits for the server to take it
+// void input, void return
+void sendBoardFrame() {
+	uint8_t packed[PACKED_BOARD];
+	uint8_t reply[MAX_PAYLOAD];
+	char replyType = 0;
+	packTiles(packed);
+	sendFrame('I', packed, PACKED_BOARD);
+	while (!(readFrame(replyType, reply) >= 0 && replyType == 'A'));
+}
+
+// remembers the active piece before it locks, for the next lock event
+// void input, void return
+void recordLock() {
+	for (int i = 0; i < 4; ++i) {
+		lastLock[i][0] = currentPiece[i][0];
+		lastLock[i][1] = currentPiece[i][1];
+	}
+	lockPending = true;
+}
+
+// reports the last lock, the piece now in play, the board checksum and the
+// level, which sets how long the server may think
+// input: next piece ID, void return
+void sendLockEvent(int next) {
+	uint8_t payload[MAX_PAYLOAD];
+	uint8_t packed[PACKED_BOARD];
+	int length = 0;
+	payload[length++] = lockPending ? 4 : 0;
+	for (int i = 0; i < 4 && lockPending; ++i) {
+		payload[length++] = lastLock[i][0];
+		payload[length++] = lastLock[i][1];
+	}
+	payload[length++] = currentColour - 1;
+	packTiles(packed);
+	uint16_t checksum = boardChecksum(packed);
+	payload[length++] = checksum >> 8;
+	payload[length++] = checksum & 0xFF;
+	if (linkVersion >= 4) {
+		payload[length++] = level < 255 ? level : 255;
+	}
+	payload[length++] = next;
+	lockPending = false;
+	sendFrame('L', payload, length);
+}
+
 // generate next piece ID; NOT random
 // weighted to give spacing between identical pieces
 // leaves 3 gap minimum between identical pieces
@@ -378,149 +430,57 @@ bool canMove(int directionX, int directionY) {
 // }
 
 
-int convertCoord (short num, bool isX) {
+void attemptRotation(int clockwise) {
 	/*
-		Converts coordinates into usable rotation offsets
+		Attempts to rotate a piece using the shared SRS tables.
 		Parameters:
-			num (short): number to convert
-			isX (bool): number is an x-coordinate
-	*/
-	if (isX) {
-		return (num / 10) - 3;
-	} else {
-		return (num % 10) - 3;
-	}
-}
-
-
-void rotateTile(int xCoord, int yCoord, int refX, int refY, int clockRot, int tileIndex) {
-	/*
-		Rotates individual tiles.
-		Parameters:
-			xCoord (int): x-coordinate of tile to rotate
-			yCoord (int): y-coordinate of tile to rotate
-			refX (int): x-coordinate of pivot tile
-			refY (int): y-coordinate of pivot tile
-			clockRot (int): clockwise or not [1 for CW]
-			tileIndex (int): index of tile in piece
+			clockwise (int): Indicates if rotation is CW or CCW [1 for CW, -1 for CCW]
 	*/
 	// variable declaration
-	int relativeX = xCoord - refX;
-	int relativeY = yCoord - refY;
+	int piece = currentColour - 1;
+	int newRotIndex = (currentRotIndex + clockwise + 4) % 4;
+	int dir = (clockwise == 1) ? 0 : 1;
+	int pivotX = currentPiece[0][0];
+	int pivotY = currentPiece[0][1];
 	int newX;
 	int newY;
-	// check for CW or CCW
-	if (clockRot == 1) {
-		newX = relativeY;
-		newY = -relativeX;
-	} else {
-		newX = -relativeY;
-		newY = relativeX;
-	}
-	newX += refX;
-	newY += refY;
-	// store into globals
-	int tempX = currentPiece[tileIndex][0];
-	int tempY = currentPiece[tileIndex][1];
-
-	beforeRot[tileIndex][0] = tempX;
-	beforeRot[tileIndex][1] = tempY;
-	currentPiece[tileIndex][0] = newX;
-	currentPiece[tileIndex][1] = newY;
-}
-
-
-void runRotTest (int blockType, int oldRotIndex, int newRotIndex, int testNum) {
-	/*
-		Runs rotation offset tests.
-		Parameters:
-			blockType (int): Indicates the type of piece
-			oldRotIndex (int): Rotation index before rotation performed
-			newRotIndex (int): Rotation index after rotation performed
-			testNum (int): Which test is being used (5 tests total)
-	*/
-	// I block test
-	if (blockType == 1) {
-		offTotalX = convertCoord(Ioffset[testNum][oldRotIndex], true) - convertCoord(Ioffset[testNum][newRotIndex], true);
-		offTotalY = convertCoord(Ioffset[testNum][oldRotIndex], false) - convertCoord(Ioffset[testNum][newRotIndex], false);
-	// everything else test
-	} else {
-		offTotalX = convertCoord(JLSTZoffset[testNum][oldRotIndex], true) - convertCoord(JLSTZoffset[testNum][newRotIndex], true);
-		offTotalY = convertCoord(JLSTZoffset[testNum][oldRotIndex], false) - convertCoord(JLSTZoffset[testNum][newRotIndex], false);
-	}
-}
-
-
-void attemptRotation(int clockwise, bool doOffset) {
-	/*
-		Attempts to rotate a piece.
-		Parameters:
-			clockwise (int): Indicates if rotation is CW or CCW [1 for CW, -1 for CCW]
-			doOffset (bool): Indicate if offset tests should be run
-	*/
-	// variable declaration
-	int blockType;
-	int oldRotIndex = currentRotIndex;
 	int tempX;
 	int tempY;
-	int befX;
-	int befY;
-	String inLine;
-	currentRotIndex += clockwise;
-	currentRotIndex = (currentRotIndex % 4 + 4) % 4;	// 4 is amount of possibl rot. indices
-
-	// perform rotation for each tile
-	for (int i = 0; i < 4; ++i) {
-		rotateTile(currentPiece[i][0], currentPiece[i][1], currentPiece[0][0], currentPiece[0][1], clockwise, i);
-	}
-	// stop if no offset necessary
-	if (!doOffset) {
-		for (int i = 0; i < 4; ++i) {
-			int tempX = currentPiece[i][0];
-			int tempY = currentPiece[i][1];
-			// draw on board
-			tft.fillRect(tempX*24, 456 - tempY*24, 24, 24, colors[currentColour]);
-			tft.drawRect(tempX*24, 456 - tempY*24, 24, 24, colors[0]);
-		}
-		return;
-	}
-	// determine piece type
-	if (colors[currentColour] == 0x07FF) {	// cyan = I piece
-		blockType = 1;
-	} else if (colors[currentColour] == 0xFFE0) {	// yellow = O piece
-		attemptRotation(-clockwise, false);
-		return;
-	} else {	// other
-		blockType = 2;
-	}
+	bool fits;
 	// run offset tests
 	for (int i = 0; i < 5; ++i) {
-		runRotTest(blockType, oldRotIndex, currentRotIndex, i);
-		// check if can move
-      	if(canMove(offTotalX, offTotalY)) {
-        	for (int j = 0; j < 4; ++j) {
-          	// apply offset
-          	currentPiece[j][0] += offTotalX;
-          	currentPiece[j][1] += offTotalY;
-          	// erase previous position
-          	befX = beforeRot[j][0];
-          	befY = beforeRot[j][1];
-          	tft.fillRect(befX*24, 456 - befY*24, 24, 24, colors[0]);
-        	}
-        	for (int j = 0; j < 4; ++j) {
-          	// draw new position
-          	tempX = currentPiece[j][0];
-          	tempY = currentPiece[j][1];
-          	tft.fillRect(tempX*24, 456 - tempY*24, 24, 24, colors[currentColour]);
-          	tft.drawRect(tempX*24, 456 - tempY*24, 24, 24, colors[0]);
-        }
-        return;
-      }
+		newX = pivotX + rotationKicks[piece][currentRotIndex][dir][i][0];
+		newY = pivotY + rotationKicks[piece][currentRotIndex][dir][i][1];
+		fits = true;
+		for (int j = 0; j < 4; ++j) {
+			tempX = newX + pieceCells[piece][newRotIndex][j][0];
+			tempY = newY + pieceCells[piece][newRotIndex][j][1];
+			if (tempX < 0 || tempX > 9 || tempY < 0 || tempY > 19 || tiles[tempX][tempY] != 0) {
+				fits = false;
+				break;
+			}
+		}
+		if (fits) {
+			// erase previous position
+			for (int j = 0; j < 4; ++j) {
+				tft.fillRect(currentPiece[j][0]*24, 456 - currentPiece[j][1]*24, 24, 24, colors[0]);
+			}
+			// draw new position
+			for (int j = 0; j < 4; ++j) {
+				tempX = newX + pieceCells[piece][newRotIndex][j][0];
+				tempY = newY + pieceCells[piece][newRotIndex][j][1];
+				currentPiece[j][0] = tempX;
+				currentPiece[j][1] = tempY;
+				tft.fillRect(tempX*24, 456 - tempY*24, 24, 24, colors[currentColour]);
+				tft.drawRect(tempX*24, 456 - tempY*24, 24, 24, colors[0]);
+			}
+			currentRotIndex = newRotIndex;
+			return;
+		}
 	}
-	// rotate backwards if all offset tests fail
-	attemptRotation(-clockwise, false);
+	// piece stays put if all offset tests fail
 }
-	
+
 
 void processJoystick() {
 	// joystick inputs
@@ -571,6 +531,8 @@ void tetris() {
 	int remActions = 0;
 	bool moveLeft = false;
 	int rots = 0;
+	char replyType;
+	uint8_t reply[MAX_PAYLOAD];
 
 	activePiece = true;
 	temp = getNext();
@@ -631,38 +593,77 @@ void tetris() {
 		if (aiLock == 0) {
 			if (joyVal == 0 && !aiActive) {
 				aiActive = true;
-				strTemp = "I ";
-				// concatenate tile data
-				for (int i = 0; i < 200; ++i) {
-					strTemp += String(tiles[i%10][i/10]);
-				}
-				Serial.println(strTemp);
-				clientState = WaitingForAck;
-				// wait for acknowledgement from server
-				while (clientState == WaitingForAck) {
-					Serial.setTimeout(50);
-					strTemp = Serial.readString();
-					if (strTemp[0] == 'A') {
-						clientState = SendingPiece;
+				negotiateFraming();
+				if (linkVersion >= 2) {
+					// the server owns the board from here on: send it once, then
+					// drop the piece in play like a rock; its lock is the
+					// first event the server hears about
+					sendBoardFrame();
+					moveInstr = 0;
+					clientState = ProcessingPiece;
+				} else {
+					if (linkVersion >= 1) {
+						// board as 25 bytes, one bit per tile
+						uint8_t packed[PACKED_BOARD];
+						packTiles(packed);
+						sendFrame('I', packed, PACKED_BOARD);
+					} else {
+						strTemp = "I ";
+						// concatenate tile data
+						for (int i = 0; i < 200; ++i) {
+							strTemp += String(tiles[i%10][i/10]);
+						}
+						Serial.println(strTemp);
 					}
-				}
-				// sending current piece
-				strTemp = "C ";
-				for (int i = 0; i < 4; ++i) {
-					strTemp += String(currentPiece[i][0]);
-					strTemp += " ";
-					strTemp += String(currentPiece[i][1]);
-					strTemp += " ";
-				}
-				strTemp += currentRotIndex;
-				Serial.println(strTemp);
-				clientState = WaitingForAck;
-				// waiting for acknowledgement from server
-				while (clientState == WaitingForAck) {
-					Serial.setTimeout(50);
-					strTemp = Serial.readString();
-					if (strTemp[0] == 'A') {
-						clientState = SendingPiece;
+					clientState = WaitingForAck;
+					// wait for acknowledgement from server
+					while (clientState == WaitingForAck) {
+						if (linkVersion >= 1) {
+							if (readFrame(replyType, reply) >= 0 && replyType == 'A') {
+								clientState = SendingPiece;
+							}
+						} else {
+							Serial.setTimeout(50);
+							strTemp = Serial.readString();
+							if (strTemp[0] == 'A') {
+								clientState = SendingPiece;
+							}
+						}
+					}
+					// sending current piece
+					if (linkVersion >= 1) {
+						uint8_t piece[PACKED_PIECE];
+						for (int i = 0; i < 4; ++i) {
+							piece[2*i] = currentPiece[i][0];
+							piece[2*i + 1] = currentPiece[i][1];
+						}
+						piece[8] = currentRotIndex;
+						sendFrame('C', piece, PACKED_PIECE);
+					} else {
+						strTemp = "C ";
+						for (int i = 0; i < 4; ++i) {
+							strTemp += String(currentPiece[i][0]);
+							strTemp += " ";
+							strTemp += String(currentPiece[i][1]);
+							strTemp += " ";
+						}
+						strTemp += currentRotIndex;
+						Serial.println(strTemp);
+					}
+					clientState = WaitingForAck;
+					// waiting for acknowledgement from server
+					while (clientState == WaitingForAck) {
+						if (linkVersion >= 1) {
+							if (readFrame(replyType, reply) >= 0 && replyType == 'A') {
+								clientState = SendingPiece;
+							}
+						} else {
+							Serial.setTimeout(50);
+							strTemp = Serial.readString();
+							if (strTemp[0] == 'A') {
+								clientState = SendingPiece;
+							}
+						}
 					}
 				}
 			} else if (joyVal == 0) {
@@ -684,11 +685,11 @@ void tetris() {
 				if(rotLock == 0) {
 					if (digitalRead(CLOCKWISE_BUTTON) == LOW) {
 						// 1 is for clockwise
-						attemptRotation(1, true);
+						attemptRotation(1);
 						rotLock = 500;
 					} else if (digitalRead(COUNTER_BUTTON) == LOW) {
 						// -1 is for counterclockwise
-						attemptRotation(-1, true);
+						attemptRotation(-1);
 						rotLock = 500;
 					}
 				} else {
@@ -707,9 +708,39 @@ void tetris() {
 		// ai active
 		} else {
 			if (clientState == SendingPiece) {
-				strTemp = "R " + String(next);
-				Serial.println(strTemp);
+				if (linkVersion >= 2) {
+					sendLockEvent(next);
+				} else if (linkVersion >= 1) {
+					uint8_t preview = next;
+					sendFrame('R', &preview, 1);
+				} else {
+					strTemp = "R " + String(next);
+					Serial.println(strTemp);
+				}
 				clientState = WaitingForAck;
+			} else if (clientState == WaitingForAck && linkVersion >= 1) {
+				// the reply carries moveInstr as one signed byte
+				int replyLength = readFrame(replyType, reply);
+				if (replyLength == 0 && replyType == 'S') {
+					// the server's board disagrees with ours: resend it, then
+					// report the spawn again without the lock it already has
+					sendBoardFrame();
+					lockPending = false;
+					clientState = SendingPiece;
+				} else if (replyLength >= 0 && replyType == 'P') {
+					// version 3: the move as single inputs
+					for (int i = 0; i < replyLength; ++i) {
+						movePath[i] = reply[i];
+					}
+					pathLength = replyLength;
+					clientState = ProcessingPiece;
+				} else if (replyLength == 1 && replyType == 'A') {
+					clientState = ProcessingPiece;
+					moveInstr = (int8_t) reply[0];
+					moveLeft = moveInstr < 0;
+					remActions = (abs(moveInstr/10) != 9) ? abs(moveInstr/10) : 0;
+					remActions += abs(moveInstr)%10;
+				}
 			} else if (clientState == WaitingForAck) {
 				Serial.setTimeout(50);
 				strTemp = Serial.readString();
@@ -740,10 +771,35 @@ void tetris() {
 					moveInstr = strInstr.toInt();
 					remActions += rots;
 				}
+			} else if (clientState == ProcessingPiece && pathLength >= 0) {
+				// play the path input by input
+				for (int i = 0; i < pathLength; ++i) {
+					if (movePath[i] == PATH_LEFT && canMove(-1, 0)) {
+						activeShift(3);
+					} else if (movePath[i] == PATH_RIGHT && canMove(1, 0)) {
+						activeShift(1);
+					} else if (movePath[i] == PATH_CW) {
+						attemptRotation(1);
+					} else if (movePath[i] == PATH_CCW) {
+						attemptRotation(-1);
+					} else if (movePath[i] == PATH_DROP) {
+						while (canMove(0, -1)) {
+							activeShift(2);
+						}
+					}
+				}
+				pathLength = -1;
+				// then lock where it lands
+				while (canMove(0, -1)) {
+					activeShift(2);
+				}
+				recordLock();
+				lockPiece();
+				clientState = SendingPiece;
 			} else if (clientState == ProcessingPiece) {
 				// emulate move
 				for (int i = 0; i < abs(moveInstr)%10; i++) {
-					attemptRotation(1, true);
+					attemptRotation(1);
 				}
 				// shift
 				for (int i = 0; i < abs(moveInstr/10); i++) {
@@ -759,6 +815,7 @@ void tetris() {
 				while (canMove(0, -1)) {
 					activeShift(2);
 				}
+				recordLock();
 				lockPiece();
 				clientState = SendingPiece;
 			}
@@ -770,6 +827,8 @@ void tetris() {
 					if (canMove(0, -1)) {
 						activeShift(2);
 					} else {
+						// the server still has to hear about a lock gravity made
+						recordLock();
 						lockPiece();
 					}
 				}	
@@ -779,7 +838,9 @@ void tetris() {
 		for (int i = 0; i < 10; i++) {
 			if (tiles[i][19] != 0) {
 				gameActive = false;
-				if (aiActive) {
+				if (aiActive && linkVersion >= 1) {
+					sendFrame('X', 0, 0);
+				} else if (aiActive) {
 					Serial.println("X\n");
 				}
 			}
@@ -0,0 +1,134 @@
+#include "threadPool.h"
+
+using namespace std;
+
+// index of the pool worker running on this thread, -1 for outside threads
+static thread_local int workerIndex = -1;
+static thread_local const ThreadPool* workerPool = 0;
+
+ThreadPool::ThreadPool(int numThreads) : stopping(false), queued(0), nextWorker(0) {
+	if (numThreads <= 0) {
+		numThreads = thread::hardware_concurrency();
+	}
+	if (numThreads <= 0) {
+		numThreads = 1;
+	}
+	for (int i = 0; i < numThreads; ++i) {
+		workers.push_back(new Worker());
+	}
+	for (int i = 0; i < numThreads; ++i) {
+		threads.push_back(thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+	for (size_t i = 0; i < workers.size(); ++i) {
+		delete workers[i];
+	}
+}
+
+int ThreadPool::size() const {
+	return workers.size();
+}
+
+void ThreadPool::submit(TaskGroup& group, const function<void()>& task) {
+	int target;
+	if (workerPool == this) {
+		target = workerIndex;
+	} else {
+		target = nextWorker++ % workers.size();
+	}
+	group.pending++;
+	{
+		lock_guard<mutex> guard(workers[target]->lock);
+		workers[target]->tasks.push_back(Task{task, &group});
+	}
+	queued++;
+	// a worker checks queued under sleepLock before sleeping, so taking the
+	// lock here means it is either already asleep or will see the task
+	{
+		lock_guard<mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::runOne(int self, const TaskGroup* only) {
+	/*
+		Runs one queued task, if any.
+		Parameters:
+			self (int): worker index of the caller, -1 for outside threads
+			only (TaskGroup*): run only a task of this group, or any task
+				if null
+		Own deque is popped from the back (newest, still hot in cache),
+		other deques are robbed from the front (oldest, biggest subtrees).
+	*/
+	Task task;
+	bool found = false;
+	int n = workers.size();
+	if (self >= 0) {
+		lock_guard<mutex> guard(workers[self]->lock);
+		deque<Task>& tasks = workers[self]->tasks;
+		for (int i = (int) tasks.size() - 1; i >= 0 && !found; --i) {
+			if (!only || tasks[i].group == only) {
+				task = tasks[i];
+				tasks.erase(tasks.begin() + i);
+				found = true;
+			}
+		}
+	}
+	for (int i = 1; i <= n && !found; ++i) {
+		int victim = (self + i + n) % n;
+		lock_guard<mutex> guard(workers[victim]->lock);
+		deque<Task>& tasks = workers[victim]->tasks;
+		for (size_t j = 0; j < tasks.size() && !found; ++j) {
+			if (!only || tasks[j].group == only) {
+				task = tasks[j];
+				tasks.erase(tasks.begin() + j);
+				found = true;
+			}
+		}
+	}
+	if (!found) {
+		return false;
+	}
+	queued--;
+	task.run();
+	task.group->pending--;
+	return true;
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	int self = (workerPool == this) ? workerIndex : -1;
+	// only the group's own tasks: another caller's task, such as a whole
+	// hosted game's decision, would hold this wait until it finished
+	while (group.pending > 0) {
+		if (!runOne(self, &group)) {
+			this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::workerLoop(int index) {
+	workerIndex = index;
+	workerPool = this;
+	while (true) {
+		if (runOne(index, 0)) {
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		if (stopping) {
+			return;
+		}
+		if (queued == 0) {
+			wake.wait(guard);
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// tasks submitted together; wait() on the pool returns once all are done
+struct TaskGroup {
+	std::atomic<int> pending;
+	TaskGroup() : pending(0) {}
+};
+
+// work-stealing pool: every worker owns a deque, runs its own newest task
+// first and steals the oldest task of another worker when it runs dry
+class ThreadPool {
+public:
+	// numThreads <= 0 uses one thread per core
+	explicit ThreadPool(int numThreads);
+	~ThreadPool();
+
+	// queues a task on the calling worker's deque (or spreads tasks from
+	// outside threads across all deques)
+	void submit(TaskGroup& group, const std::function<void()>& task);
+	// runs the group's queued tasks on the calling thread until the group
+	// is done, so nested waits inside tasks cannot deadlock the pool; tasks
+	// of other groups are left to the workers
+	void wait(TaskGroup& group);
+	int size() const;
+
+private:
+	struct Task {
+		std::function<void()> run;
+		TaskGroup* group;
+	};
+	struct Worker {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	bool runOne(int self, const TaskGroup* only);
+	void workerLoop(int index);
+
+	std::vector<Worker*> workers;
+	std::vector<std::thread> threads;
+	std::atomic<bool> stopping;
+	std::atomic<int> queued;
+	std::atomic<unsigned> nextWorker;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef TRACKEDBOARD_H
+#define TRACKEDBOARD_H
+
+#include "bitboard.h"
+
+// bitboard plus the per-column and per-row counts the evaluator needs,
+// kept up to date as pieces lock and lines clear
+struct TrackedBoard {
+	Bitboard board;
+	int8_t tops[BOARD_WIDTH];	// one above the highest tile, 0 if empty
+	int8_t colCount[BOARD_WIDTH];	// tiles in each column
+	int8_t rowFill[BOARD_HEIGHT];	// tiles in each row
+	int sumHeights;	// sum of the evaluator's column heights
+	int holes;	// empty cells under the top of their column
+};
+
+// what trackLock changed, so trackUndo can put it back: the search keeps
+// one per ply on its own stack, and taking a lock back costs the size of
+// the change, never a board copy
+// a clear moves every row above the lowest cleared one and changes every
+// column's counts, so it also keeps all the old tops and the totals
+struct TrackUndo {
+	PieceMask mask;
+	int8_t tops[BOARD_WIDTH];	// old tops: of the columns under the mask, or all after a clear
+	int numClear;
+	int8_t clearedRows[4];	// rows the lock filled, lowest first
+	int sumHeights;	// old totals and hash, after a clear
+	int holes;
+	uint64_t hash;
+};
+
+// the evaluator's height of a column: index of its highest tile, 0 if empty
+inline int columnHeight(int top) {
+	return top > 0 ? top - 1 : 0;
+}
+
+inline void initTracked(TrackedBoard& tracked, const Bitboard& board) {
+	/*
+		Builds the counts from scratch.
+		Parameters:
+			tracked (TrackedBoard): board to fill in
+			board (Bitboard): tiles to count
+	*/
+	tracked.board = board;
+	tracked.sumHeights = 0;
+	tracked.holes = 0;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		tracked.tops[i] = 0;
+		tracked.colCount[i] = 0;
+	}
+	for (int j = 0; j < BOARD_HEIGHT; ++j) {
+		uint16_t row = board.rows[j];
+		tracked.rowFill[j] = __builtin_popcount(row);
+		while (row) {
+			int i = __builtin_ctz(row);
+			tracked.colCount[i]++;
+			tracked.tops[i] = j + 1;
+			row &= row - 1;
+		}
+	}
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		tracked.sumHeights += columnHeight(tracked.tops[i]);
+		tracked.holes += tracked.tops[i] - tracked.colCount[i];
+	}
+}
+
+// adds or removes the piece's cells in the row and column counts; adding
+// also raises the tops, trackUndo puts the old ones back itself
+inline void trackCells(TrackedBoard& tracked, const PieceMask& mask, int sign) {
+	for (int i = 0; i < mask.height; ++i) {
+		uint16_t bits = mask.rows[i];
+		tracked.rowFill[mask.y + i] += sign * __builtin_popcount(bits);
+		while (bits) {
+			int column = mask.x + __builtin_ctz(bits);
+			tracked.colCount[column] += sign;
+			if (sign > 0 && tracked.tops[column] < mask.y + i + 1) {
+				tracked.tops[column] = mask.y + i + 1;
+			}
+			bits &= bits - 1;
+		}
+	}
+}
+
+inline void trackClear(TrackedBoard& tracked, const int8_t* clearedRows, int numClear) {
+	/*
+		Removes full rows and moves the rows above them down, counts
+		included; only the rows from the lowest cleared one up are touched.
+		Parameters:
+			tracked (TrackedBoard): board whose counts include the full rows
+			clearedRows (int8_t*): the full rows, lowest first
+			numClear (int): number of full rows
+	*/
+	clearLines(tracked.board, clearedRows[0], clearedRows[numClear - 1] + 1);
+	int dest = clearedRows[0];
+	for (int i = clearedRows[0], k = 0; i < BOARD_HEIGHT; ++i) {
+		if (k < numClear && i == clearedRows[k]) {
+			k++;
+		} else {
+			tracked.rowFill[dest++] = tracked.rowFill[i];
+		}
+	}
+	while (dest < BOARD_HEIGHT) {
+		tracked.rowFill[dest++] = 0;
+	}
+	// full rows held a tile in every column, so every top is above them and
+	// drops by numClear, unless the top tile itself was cleared
+	tracked.sumHeights = 0;
+	tracked.holes = 0;
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		int top = tracked.tops[i] - numClear;
+		while (top > 0 && !((tracked.board.rows[top - 1] >> i) & 1)) {
+			top--;
+		}
+		tracked.tops[i] = top;
+		tracked.colCount[i] -= numClear;
+		tracked.sumHeights += columnHeight(top);
+		tracked.holes += top - tracked.colCount[i];
+	}
+}
+
+inline int trackLock(TrackedBoard& tracked, const PieceMask& mask, TrackUndo& undo) {
+	/*
+		Locks a piece and clears lines, updating the counts.
+		Without a line clear only the piece's own rows and columns are
+		touched; a clear also moves the rows above it.
+		Parameters:
+			tracked (TrackedBoard): board to update
+			mask (PieceMask): piece at its final position
+			undo (TrackUndo): out, what to restore on trackUndo
+		Returns the number of cleared lines.
+	*/
+	undo.mask = mask;
+	undo.numClear = 0;
+	for (int i = 0; i < mask.height; ++i) {
+		if (tracked.rowFill[mask.y + i] + __builtin_popcount(mask.rows[i]) == BOARD_WIDTH) {
+			undo.clearedRows[undo.numClear++] = mask.y + i;
+		}
+	}
+	if (undo.numClear > 0) {
+		for (int i = 0; i < BOARD_WIDTH; ++i) {
+			undo.tops[i] = tracked.tops[i];
+		}
+		undo.sumHeights = tracked.sumHeights;
+		undo.holes = tracked.holes;
+		undo.hash = tracked.board.hash;
+		lockMask(tracked.board, mask, 0, 0);
+		trackCells(tracked, mask, 1);
+		trackClear(tracked, undo.clearedRows, undo.numClear);
+		return undo.numClear;
+	}
+	for (int i = 0; i < mask.width; ++i) {
+		int column = mask.x + i;
+		undo.tops[i] = tracked.tops[column];
+		tracked.sumHeights -= columnHeight(tracked.tops[column]);
+		tracked.holes -= tracked.tops[column] - tracked.colCount[column];
+	}
+	lockMask(tracked.board, mask, 0, 0);
+	trackCells(tracked, mask, 1);
+	for (int i = 0; i < mask.width; ++i) {
+		int column = mask.x + i;
+		tracked.sumHeights += columnHeight(tracked.tops[column]);
+		tracked.holes += tracked.tops[column] - tracked.colCount[column];
+	}
+	return 0;
+}
+
+// puts cleared rows back: every row from the lowest cleared one up moves
+// back to where it was, and the cleared rows come back full
+inline void untrackClear(TrackedBoard& tracked, const TrackUndo& undo) {
+	int k = undo.numClear;
+	for (int i = BOARD_HEIGHT - 1; i >= undo.clearedRows[0]; --i) {
+		if (k > 0 && i == undo.clearedRows[k - 1]) {
+			tracked.board.rows[i] = FULL_ROW;
+			tracked.rowFill[i] = BOARD_WIDTH;
+			k--;
+		} else {
+			tracked.board.rows[i] = tracked.board.rows[i - k];
+			tracked.rowFill[i] = tracked.rowFill[i - k];
+		}
+	}
+	for (int i = 0; i < BOARD_WIDTH; ++i) {
+		tracked.colCount[i] += undo.numClear;
+		tracked.tops[i] = undo.tops[i];
+	}
+}
+
+inline void trackUndo(TrackedBoard& tracked, const TrackUndo& undo) {
+	/*
+		Takes back the last trackLock: O(piece cells) without a clear,
+		O(rows above the clear) with one.
+		Parameters:
+			tracked (TrackedBoard): board to restore
+			undo (TrackUndo): record filled in by trackLock
+	*/
+	const PieceMask& mask = undo.mask;
+	if (undo.numClear > 0) {
+		untrackClear(tracked, undo);
+		for (int i = 0; i < mask.height; ++i) {
+			tracked.board.rows[mask.y + i] &= ~(mask.rows[i] << mask.x);
+		}
+		trackCells(tracked, mask, -1);
+		tracked.sumHeights = undo.sumHeights;
+		tracked.holes = undo.holes;
+		tracked.board.hash = undo.hash;
+		return;
+	}
+	for (int i = 0; i < mask.width; ++i) {
+		int column = mask.x + i;
+		tracked.sumHeights -= columnHeight(tracked.tops[column]);
+		tracked.holes -= tracked.tops[column] - tracked.colCount[column];
+	}
+	for (int i = 0; i < mask.height; ++i) {
+		uint16_t placed = mask.rows[i] << mask.x;
+		tracked.board.rows[mask.y + i] &= ~placed;
+		tracked.board.hash ^= rowKey(mask.y + i, placed);
+	}
+	trackCells(tracked, mask, -1);
+	for (int i = 0; i < mask.width; ++i) {
+		int column = mask.x + i;
+		tracked.tops[column] = undo.tops[i];
+		tracked.sumHeights += columnHeight(tracked.tops[column]);
+		tracked.holes += tracked.tops[column] - tracked.colCount[column];
+	}
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "transposition.h"
+
+using namespace std;
+
+TranspositionTable::TranspositionTable(int sizeBits) : epoch(1), numProbes(0), numHits(0), numStores(0) {
+	uint64_t slots = 1ULL << sizeBits;
+	if (slots < TABLE_WAYS) {
+		slots = TABLE_WAYS;
+	}
+	bucketMask = slots / TABLE_WAYS - 1;
+	buckets = new Bucket[bucketMask + 1];
+	clear();
+}
+
+TranspositionTable::~TranspositionTable() {
+	delete[] buckets;
+}
+
+// slots in bucket order, for clearing and saving the whole table
+TranspositionTable::Entry& TranspositionTable::slot(long index) const {
+	return buckets[index / TABLE_WAYS].slots[index % TABLE_WAYS];
+}
+
+bool TranspositionTable::probe(uint64_t key, int& value) {
+	Entry* bucket = buckets[key & bucketMask].slots;
+	numProbes.fetch_add(1, memory_order_relaxed);
+	// key 0 is never stored, so cleared slots always miss
+	if (key == 0) {
+		return false;
+	}
+	for (int i = 0; i < TABLE_WAYS; ++i) {
+		int32_t stored = bucket[i].value.load(memory_order_relaxed);
+		if ((bucket[i].check.load(memory_order_relaxed) ^ (uint32_t) stored) == key) {
+			uint32_t now = epoch.load(memory_order_relaxed);
+			// only write when the epoch moved, so hot entries do not bounce
+			// their cache line between threads
+			if (bucket[i].used.load(memory_order_relaxed) != now) {
+				bucket[i].used.store(now, memory_order_relaxed);
+			}
+			numHits.fetch_add(1, memory_order_relaxed);
+			value = stored;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TranspositionTable::store(uint64_t key, int value) {
+	Entry* bucket = buckets[key & bucketMask].slots;
+	// the slot that already holds key, else the least recently used one
+	int victim = 0;
+	uint32_t oldest = 0xFFFFFFFF;
+	for (int i = 0; i < TABLE_WAYS; ++i) {
+		uint64_t check = bucket[i].check.load(memory_order_relaxed);
+		if ((check ^ (uint32_t) bucket[i].value.load(memory_order_relaxed)) == key) {
+			victim = i;
+			break;
+		}
+		uint32_t used = check ? bucket[i].used.load(memory_order_relaxed) : 0;
+		if (used < oldest) {
+			oldest = used;
+			victim = i;
+		}
+	}
+	Entry& entry = bucket[victim];
+	entry.check.store(key ^ (uint32_t) value, memory_order_relaxed);
+	entry.value.store(value, memory_order_relaxed);
+	entry.used.store(epoch.load(memory_order_relaxed), memory_order_relaxed);
+	numStores.fetch_add(1, memory_order_relaxed);
+}
+
+void TranspositionTable::age() {
+	epoch.fetch_add(1, memory_order_relaxed);
+}
+
+void TranspositionTable::clear() {
+	for (long i = 0; i < size(); ++i) {
+		slot(i).check.store(0, memory_order_relaxed);
+		slot(i).value.store(0, memory_order_relaxed);
+		slot(i).used.store(0, memory_order_relaxed);
+	}
+}
+
+bool TranspositionTable::save(const char* path, uint64_t tag) const {
+	/*
+		Maps a new file the size of the table and copies the slots into it;
+		the file is written under a temporary name and renamed, so a reader
+		never sees half a table.
+		Parameters:
+			path (char*): file to write
+			tag (uint64_t): what the values depend on, checked by load
+	*/
+	size_t bytes = sizeof(FileHeader) + size() * sizeof(SavedEntry);
+	string temp = string(path) + ".tmp";
+	int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, bytes) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	void* mapped = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	FileHeader* header = (FileHeader*) mapped;
+	memcpy(header->magic, TABLE_FILE_MAGIC, TABLE_FILE_MAGIC_SIZE);
+	header->tag = tag;
+	header->slots = size();
+	header->epoch = epoch.load(memory_order_relaxed);
+	SavedEntry* saved = (SavedEntry*) (header + 1);
+	for (long i = 0; i < size(); ++i) {
+		saved[i].check = slot(i).check.load(memory_order_relaxed);
+		saved[i].value = slot(i).value.load(memory_order_relaxed);
+		saved[i].used = slot(i).used.load(memory_order_relaxed);
+	}
+	bool synced = msync(mapped, bytes, MS_SYNC) == 0;
+	munmap(mapped, bytes);
+	return synced && rename(temp.c_str(), path) == 0;
+}
+
+bool TranspositionTable::load(const char* path, uint64_t tag) {
+	/*
+		Maps a table written by save and copies its slots in.
+		Parameters:
+			path (char*): file to read
+			tag (uint64_t): must match the tag it was saved with
+	*/
+	size_t bytes = sizeof(FileHeader) + size() * sizeof(SavedEntry);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	off_t length = lseek(fd, 0, SEEK_END);
+	void* mapped = length == (off_t) bytes ? mmap(0, bytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	const FileHeader* header = (const FileHeader*) mapped;
+	bool matches = memcmp(header->magic, TABLE_FILE_MAGIC, TABLE_FILE_MAGIC_SIZE) == 0 && header->tag == tag
+		&& header->slots == (uint64_t) size();
+	if (matches) {
+		madvise(mapped, bytes, MADV_SEQUENTIAL);
+		const SavedEntry* saved = (const SavedEntry*) (header + 1);
+		for (long i = 0; i < size(); ++i) {
+			slot(i).check.store(saved[i].check, memory_order_relaxed);
+			slot(i).value.store(saved[i].value, memory_order_relaxed);
+			slot(i).used.store(saved[i].used, memory_order_relaxed);
+		}
+		epoch.store(header->epoch, memory_order_relaxed);
+	}
+	munmap(mapped, bytes);
+	return matches;
+}
+
+long TranspositionTable::probes() const {
+	return numProbes;
+}
+
+long TranspositionTable::hits() const {
+	return numHits;
+}
+
+long TranspositionTable::stores() const {
+	return numStores;
+}
+
+double TranspositionTable::hitRate() const {
+	long total = numProbes;
+	return total ? (double) numHits / total : 0.0;
+}
+
+void TranspositionTable::resetStats() {
+	numProbes = 0;
+	numHits = 0;
+	numStores = 0;
+}
+
+long TranspositionTable::size() const {
+	return (bucketMask + 1) * TABLE_WAYS;
+}
@@ -0,0 +1,81 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdint.h>
+#include <atomic>
+
+// slots per bucket: 4 slots of 16 bytes fill one cache line
+#define TABLE_WAYS 4
+// first bytes of a saved table
+#define TABLE_FILE_MAGIC "TTABLE1\n"
+#define TABLE_FILE_MAGIC_SIZE 8
+
+// fixed-size, lock-free cache of search values keyed by 64-bit hashes
+// each slot stores the value and the key xor the value; a reader only
+// trusts a slot when both still agree, so torn writes from other threads
+// read as misses instead of wrong values
+// slots are grouped in buckets; a new key replaces the bucket's least
+// recently used slot, where "recently" counts in epochs (age() once per
+// decision), so memory stays bounded and entries that keep being hit by
+// game after game survive
+class TranspositionTable {
+public:
+	// 2^sizeBits slots of 16 bytes each, at least one bucket
+	explicit TranspositionTable(int sizeBits);
+	~TranspositionTable();
+
+	bool probe(uint64_t key, int& value);
+	void store(uint64_t key, int value);
+	// starts a new epoch: entries touched from now on count as newer
+	void age();
+	// drops every entry, e.g. when the evaluation weights change
+	void clear();
+
+	// writes the table to path through a memory map, tagged with what its
+	// values depend on (see tableTag); false if the file cannot be written
+	bool save(const char* path, uint64_t tag) const;
+	// maps a saved table and copies it in; false, leaving the table as it
+	// was, if the file is missing, another size, or saved under another tag
+	bool load(const char* path, uint64_t tag);
+
+	// hit-rate counters, reset by resetStats()
+	long probes() const;
+	long hits() const;
+	long stores() const;
+	double hitRate() const;
+	void resetStats();
+	long size() const;
+
+private:
+	struct Entry {
+		std::atomic<uint64_t> check;	// key xor value, 0 if empty
+		std::atomic<int32_t> value;
+		std::atomic<uint32_t> used;	// epoch of the last probe hit or store
+	};
+	struct alignas(64) Bucket {
+		Entry slots[TABLE_WAYS];
+	};
+	// a saved table is a FileHeader followed by one SavedEntry per slot
+	struct FileHeader {
+		char magic[TABLE_FILE_MAGIC_SIZE];
+		uint64_t tag;
+		uint64_t slots;
+		uint64_t epoch;
+	};
+	struct SavedEntry {
+		uint64_t check;
+		int32_t value;
+		uint32_t used;
+	};
+
+	Entry& slot(long index) const;
+
+	Bucket* buckets;
+	uint64_t bucketMask;
+	std::atomic<uint32_t> epoch;
+	std::atomic<long> numProbes;
+	std::atomic<long> numHits;
+	std::atomic<long> numStores;
+};
+
+#endif
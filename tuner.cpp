@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "evaluate.h"
+#include "pieceGen.h"
+#include "search.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// tuner defaults, overridden on the command line
+#define DEFAULT_GENERATIONS 50
+#define DEFAULT_POPULATION 16
+#define DEFAULT_GAMES 8
+#define DEFAULT_MAX_PIECES 500
+
+// chance of each weight being mutated in a child, and the spread of the
+// log-normal factor it is multiplied by
+#define MUTATION_RATE 0.3
+#define MUTATION_SPREAD 0.25
+
+// bounds that keep every score inside an int
+#define MAX_HEIGHT_POWER 4
+#define MAX_LINE_BASE 40
+#define MAX_WEIGHT 100000
+
+// a candidate set of weights and its result in the current generation
+struct Individual {
+	Weights weights;
+	long fitness;	// lines cleared over the generation's games
+};
+
+// everything needed to resume a run
+struct TunerState {
+	int generation;	// next generation to evaluate
+	mt19937_64 rng;
+	vector<Individual> population;
+	Individual best;	// best individual seen so far
+};
+
+long playTuningGame(const Weights& weights, uint64_t seed, int previewLength, long maxPieces) {
+	/*
+		Plays one single-threaded self-play game for the tuner.
+		Parameters:
+			weights (Weights): weights to play with
+			seed (uint64_t): piece sequence seed
+			previewLength (int): upcoming pieces the AI is shown
+			maxPieces (long): stop after this many pieces
+		Returns the number of cleared lines.
+	*/
+	PieceGenerator gen;
+	Bitboard board;
+	int queue[MAX_PLIES];
+	long lines = 0;
+	// no table: games run side by side with different weights
+	SearchContext context = {0, 0, &weights, 0, false, false, 0, 0, 0, false};
+	seedGenerator(gen, seed);
+	clearBoard(board);
+	for (int i = 0; i <= previewLength; ++i) {
+		queue[i] = nextPiece(gen);
+	}
+	for (long pieces = 0; pieces < maxPieces; ++pieces) {
+		SearchResult result = searchMove(board, queue, previewLength + 1, context);
+		if (!result.found) {
+			break;
+		}
+		PieceMask mask = shapeMask(queue[0], result.move.rot, result.move.pivotX, result.move.pivotY);
+		lockMask(board, mask, 0, 0);
+		lines += clearLines(board, mask.y, mask.y + mask.height);
+		for (int i = 0; i < previewLength; ++i) {
+			queue[i] = queue[i + 1];
+		}
+		queue[previewLength] = nextPiece(gen);
+	}
+	return lines;
+}
+
+static int clampWeight(long value, int low, int high) {
+	return (int) max((long) low, min((long) high, value));
+}
+
+// multiplies a weight by a random log-normal factor, moving it by at least one
+static int mutateWeight(int value, mt19937_64& rng, int low, int high) {
+	normal_distribution<double> spread(0, MUTATION_SPREAD);
+	double factor = exp(spread(rng));
+	long scaled = lround(value * factor);
+	if (scaled == value) {
+		scaled += factor > 1 ? 1 : -1;
+	}
+	return clampWeight(scaled, low, high);
+}
+
+Weights makeChild(const Weights& a, const Weights& b, mt19937_64& rng) {
+	/*
+		Uniform crossover of two parents followed by mutation.
+		Parameters:
+			a, b (Weights): parents
+			rng (mt19937_64): random source
+	*/
+	uniform_int_distribution<int> coin(0, 1);
+	uniform_real_distribution<double> chance(0, 1);
+	Weights child;
+	child.height = coin(rng) ? a.height : b.height;
+	child.flat = coin(rng) ? a.flat : b.flat;
+	child.hole = coin(rng) ? a.hole : b.hole;
+	child.line = coin(rng) ? a.line : b.line;
+	child.death = coin(rng) ? a.death : b.death;
+	child.pit = coin(rng) ? a.pit : b.pit;
+	// the exponent only moves one step at a time
+	if (chance(rng) < MUTATION_RATE) {
+		child.height = clampWeight(child.height + (coin(rng) ? 1 : -1), 1, MAX_HEIGHT_POWER);
+	}
+	if (chance(rng) < MUTATION_RATE) {
+		child.flat = mutateWeight(child.flat, rng, 0, MAX_WEIGHT);
+	}
+	if (chance(rng) < MUTATION_RATE) {
+		child.hole = mutateWeight(child.hole, rng, 0, MAX_WEIGHT);
+	}
+	if (chance(rng) < MUTATION_RATE) {
+		child.line = mutateWeight(child.line, rng, 2, MAX_LINE_BASE);
+	}
+	if (chance(rng) < MUTATION_RATE) {
+		child.death = mutateWeight(child.death, rng, 0, MAX_WEIGHT);
+	}
+	if (chance(rng) < MUTATION_RATE) {
+		child.pit = mutateWeight(child.pit, rng, 0, MAX_WEIGHT);
+	}
+	return child;
+}
+
+static void writeWeights(ostream& out, const Weights& weights) {
+	out << weights.height << " " << weights.flat << " " << weights.hole << " "
+		<< weights.line << " " << weights.death << " " << weights.pit;
+}
+
+static bool readWeights(istream& in, Weights& weights) {
+	return (bool) (in >> weights.height >> weights.flat >> weights.hole
+		>> weights.line >> weights.death >> weights.pit);
+}
+
+bool saveCheckpoint(const string& path, const TunerState& state) {
+	/*
+		Writes the tuner state to path, through a temporary file so a
+		crash mid-write leaves the previous checkpoint intact.
+		Parameters:
+			path (string): checkpoint file
+			state (TunerState): state to save
+	*/
+	string temp = path + ".tmp";
+	{
+		ofstream file(temp);
+		file << "generation " << state.generation << endl;
+		file << "rng " << state.rng << endl;
+		file << "best " << state.best.fitness << " ";
+		writeWeights(file, state.best.weights);
+		file << endl << "population " << state.population.size() << endl;
+		for (size_t i = 0; i < state.population.size(); ++i) {
+			writeWeights(file, state.population[i].weights);
+			file << endl;
+		}
+		if (!file) {
+			return false;
+		}
+	}
+	return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool loadCheckpoint(const string& path, TunerState& state) {
+	ifstream file(path);
+	string label;
+	size_t size;
+	if (!file) {
+		return false;
+	}
+	if (!(file >> label >> state.generation >> label >> state.rng >> label >> state.best.fitness)
+			|| !readWeights(file, state.best.weights) || !(file >> label >> size)) {
+		return false;
+	}
+	state.population.resize(size);
+	for (size_t i = 0; i < size; ++i) {
+		if (!readWeights(file, state.population[i].weights)) {
+			return false;
+		}
+		state.population[i].fitness = 0;
+	}
+	return size > 0;
+}
+
+void evaluatePopulation(ThreadPool& pool, TunerState& state, int games, long maxPieces, int previewLength) {
+	/*
+		Plays every individual against the same games and sums their
+		lines. Every (individual, game) pair is its own pool task.
+		Parameters:
+			pool (ThreadPool): workers to spread the games over
+			state (TunerState): population to score, in place
+			games (int): games per individual
+			maxPieces (long): pieces per game before it is called
+			previewLength (int): upcoming pieces the AI is shown
+	*/
+	int size = state.population.size();
+	vector<long> lines(size * games, 0);
+	// common piece sequences within a generation, fresh ones every generation
+	uint64_t baseSeed = (uint64_t) state.generation * 1000003;
+	TaskGroup group;
+	for (int i = 0; i < size; ++i) {
+		for (int j = 0; j < games; ++j) {
+			pool.submit(group, [&, i, j]() {
+				lines[i*games + j] = playTuningGame(state.population[i].weights, baseSeed + j, previewLength, maxPieces);
+			});
+		}
+	}
+	pool.wait(group);
+	for (int i = 0; i < size; ++i) {
+		state.population[i].fitness = 0;
+		for (int j = 0; j < games; ++j) {
+			state.population[i].fitness += lines[i*games + j];
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	/*
+		Tunes the evaluation weights with a genetic algorithm over
+		parallel self-play games. Resumes from the checkpoint if it
+		exists; writes the best weights so far to <checkpoint>.weights,
+		which the server and simulator load directly.
+		Usage: tuner <checkpoint> [generations] [population] [games] [maxPieces] [preview] [threads]
+			generations: generations to run in this invocation, default 50
+			population: individuals per generation for a new run, default 16
+			games: games per individual per generation, default 8
+			maxPieces: pieces per game before it is called, default 500
+			preview: upcoming pieces shown to the AI, default 1
+			threads: worker threads, 0 for one per core, default 0
+	*/
+	if (argc < 2) {
+		cout << "usage: tuner <checkpoint> [generations] [population] [games] [maxPieces] [preview] [threads]" << endl;
+		return 1;
+	}
+	string checkpoint = argv[1];
+	string bestPath = checkpoint + ".weights";
+	int generations = argc > 2 ? atoi(argv[2]) : DEFAULT_GENERATIONS;
+	int populationSize = argc > 3 ? atoi(argv[3]) : DEFAULT_POPULATION;
+	int games = argc > 4 ? atoi(argv[4]) : DEFAULT_GAMES;
+	long maxPieces = argc > 5 ? atol(argv[5]) : DEFAULT_MAX_PIECES;
+	int previewLength = argc > 6 ? atoi(argv[6]) : 1;
+	int threads = argc > 7 ? atoi(argv[7]) : 0;
+	previewLength = max(0, min(previewLength, MAX_PLIES - 1));
+	populationSize = max(populationSize, 4);
+	games = max(games, 1);
+
+	TunerState state;
+	if (loadCheckpoint(checkpoint, state)) {
+		cout << "resuming at generation " << state.generation << " with " << state.population.size() << " individuals" << endl;
+	} else {
+		// the shipped weights plus mutated copies of them
+		state.generation = 0;
+		state.rng.seed(populationSize * 7919 + games);
+		state.best.weights = defaultWeights;
+		state.best.fitness = -1;
+		state.population.resize(populationSize);
+		state.population[0].weights = defaultWeights;
+		for (int i = 1; i < populationSize; ++i) {
+			state.population[i].weights = makeChild(defaultWeights, defaultWeights, state.rng);
+		}
+	}
+	ThreadPool pool(threads);
+	cout << "threads: " << pool.size() << ", games: " << games << " x " << maxPieces << " pieces, preview: " << previewLength << endl;
+
+	for (int g = 0; g < generations; ++g) {
+		evaluatePopulation(pool, state, games, maxPieces, previewLength);
+		sort(state.population.begin(), state.population.end(), [](const Individual& a, const Individual& b) {
+			return a.fitness > b.fitness;
+		});
+		long total = 0;
+		for (size_t i = 0; i < state.population.size(); ++i) {
+			total += state.population[i].fitness;
+		}
+		const Individual& top = state.population[0];
+		cout << "generation " << state.generation << ": best " << (double) top.fitness / games
+			<< " lines/game, mean " << (double) total / state.population.size() / games << " (";
+		writeWeights(cout, top.weights);
+		cout << ")" << endl;
+		// generations play different games, so "best" is the best score on
+		// its own generation's games
+		if (top.fitness > state.best.fitness) {
+			state.best = top;
+			saveWeights(bestPath.c_str(), state.best.weights);
+		}
+		// the top quarter survives unchanged and parents the rest
+		int elites = max(2, (int) state.population.size() / 4);
+		uniform_int_distribution<int> pick(0, elites - 1);
+		for (size_t i = elites; i < state.population.size(); ++i) {
+			state.population[i].weights = makeChild(state.population[pick(state.rng)].weights,
+				state.population[pick(state.rng)].weights, state.rng);
+		}
+		state.generation++;
+		if (!saveCheckpoint(checkpoint, state)) {
+			cout << "cannot write checkpoint " << checkpoint << endl;
+			return 1;
+		}
+	}
+	cout << "best so far: " << (double) state.best.fitness / games << " lines/game, saved to " << bestPath << endl;
+	return 0;
+}
@@ -0,0 +1,586 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "frame.h"
+#include "histogram.h"
+#include "pieceGen.h"
+
+using namespace std;
+
+// Serial.setTimeout on the client: readString returns once the line has
+// been quiet this long, readBytesUntil gives up after it
+#define READ_TIMEOUT 50
+#define NEGOTIATE_TRIES 10
+#define DEFAULT_MAX_PIECES 1000
+
+// message types with their own histograms, in report order
+const char messageTypes[] = "VICRL";
+#define NUM_TYPES 5
+
+// pty master, the client's end of the serial line, or a connection to a
+// host that is already running
+int serial = -1;
+pid_t serverPid = -1;
+bool connected = true;	// the host has not closed the connection
+int linkVersion = 0;
+int sessionId = -1;	// from the handshake reply, if the server sends one
+
+// time from the first byte sent to the reply being accepted, as the client
+// sees it (the 50 ms readString wait included), and to the first byte of
+// the reply, which is the server's own latency
+Histogram roundTrip[NUM_TYPES];
+Histogram response[NUM_TYPES];
+int64_t sentAt;
+int64_t replyAt;
+
+// the client's game
+Bitboard board;
+PieceGenerator gen;
+int piece, upcoming;
+int rot, pivotX, pivotY;
+int lastLock[4][2];
+bool lockPending = false;
+// inputs of the last 'P' reply, -1 after an 'A'
+uint8_t movePath[MAX_PAYLOAD];
+int pathLength = -1;
+
+static int64_t nowMicros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int typeIndex(char type) {
+	const char* found = strchr(messageTypes, type);
+	return found ? found - messageTypes : -1;
+}
+
+// true while the server process is still running, or the host connected
+bool serverAlive() {
+	int status;
+	if (serverPid < 0) {
+		return connected;
+	}
+	return waitpid(serverPid, &status, WNOHANG) == 0;
+}
+
+// Serial.println: the line and "\r\n"
+void sendLine(const string& line) {
+	string wire = line + "\r\n";
+	sentAt = nowMicros();
+	replyAt = 0;
+	if (write(serial, wire.data(), wire.size()) != (ssize_t) wire.size()) {
+		cout << "write failed" << endl;
+	}
+}
+
+// sendFrame on the client: the frame and a bare '\n'
+void sendFrame(char type, const uint8_t* payload, int length) {
+	uint8_t wire[MAX_WIRE_FRAME + 1];
+	int size = encodeFrame(linkVersion, type, payload, length, wire);
+	wire[size++] = '\n';
+	sentAt = nowMicros();
+	replyAt = 0;
+	if (write(serial, wire, size) != size) {
+		cout << "write failed" << endl;
+	}
+}
+
+// waits up to READ_TIMEOUT ms for one byte; false on timeout
+static bool readByte(char& byte) {
+	pollfd ready = {serial, POLLIN, 0};
+	if (poll(&ready, 1, READ_TIMEOUT) <= 0) {
+		return false;
+	}
+	if (read(serial, &byte, 1) != 1) {
+		connected = false;
+		return false;
+	}
+	if (replyAt == 0) {
+		replyAt = nowMicros();
+	}
+	return true;
+}
+
+string readString() {
+	/*
+		Serial.readString: everything that arrives until the line has been
+		quiet for READ_TIMEOUT ms, so even a complete reply costs the
+		client another 50 ms. Empty if nothing arrives.
+	*/
+	string text;
+	char byte;
+	while (readByte(byte)) {
+		text += byte;
+	}
+	return text;
+}
+
+int readFrame(char& type, uint8_t* payload) {
+	/*
+		readFrame on the client: Serial.readBytesUntil('\n'), which
+		returns as soon as the newline arrives.
+		Returns the payload length, or -1 for nothing or a damaged frame.
+	*/
+	uint8_t wire[MAX_WIRE_FRAME];
+	int size = 0;
+	char byte;
+	while (size < MAX_WIRE_FRAME && readByte(byte) && byte != '\n') {
+		wire[size++] = byte;
+	}
+	if (size <= 0) {
+		return -1;
+	}
+	int version;
+	return decodeFrame(wire, size, version, type, payload);
+}
+
+// records the reply to the last message sent
+static void recordReply(char sentType) {
+	int index = typeIndex(sentType);
+	int64_t now = nowMicros();
+	if (index >= 0) {
+		roundTrip[index].record(now - sentAt);
+		response[index].record((replyAt ? replyAt : now) - sentAt);
+	}
+}
+
+int waitReply(char sentType, char& replyType) {
+	/*
+		Reads until the server answers the last message, the way the
+		client's WaitingForAck state does.
+		Parameters:
+			sentType (char): message being answered, for the histograms
+			replyType (char&): out, 'A', or 'S' or 'P' after a lock event
+		Returns the moveInstr the reply carries, 0 if none; a 'P' reply's
+		inputs go to movePath.
+	*/
+	pathLength = -1;
+	while (true) {
+		if (linkVersion >= 1) {
+			uint8_t payload[MAX_PAYLOAD];
+			int length = readFrame(replyType, payload);
+			if (length >= 0 && replyType == 'P') {
+				recordReply(sentType);
+				memcpy(movePath, payload, length);
+				pathLength = length;
+				return 0;
+			}
+			if ((length == 0 && (replyType == 'A' || replyType == 'S')) || (length == 1 && replyType == 'A')) {
+				recordReply(sentType);
+				return length == 1 ? (int8_t) payload[0] : 0;
+			}
+		} else {
+			string text = readString();
+			if (!text.empty() && text[0] == 'A') {
+				recordReply(sentType);
+				replyType = 'A';
+				return text.size() > 2 ? atoi(text.c_str() + 2) : 0;
+			}
+		}
+		if (!serverAlive()) {
+			cout << "server exited" << endl;
+			exit(1);
+		}
+	}
+}
+
+// asks for framing like negotiateFraming on the client
+void negotiate(int version) {
+	linkVersion = 0;
+	sendLine("V " + to_string(version));
+	for (int i = 0; i < NEGOTIATE_TRIES; ++i) {
+		string text = readString();
+		if (!text.empty() && text[0] == 'A') {
+			recordReply('V');
+			int agreed = 0;
+			if (sscanf(text.c_str() + 1, "%d %d", &agreed, &sessionId) < 2) {
+				sessionId = -1;
+			}
+			if (agreed >= 1 && agreed <= FRAME_VERSION) {
+				linkVersion = agreed;
+			}
+			return;
+		}
+	}
+}
+
+void packBoard(uint8_t* packed) {
+	for (int i = 0; i < PACKED_BOARD; ++i) {
+		packed[i] = 0;
+	}
+	for (int i = 0; i < 200; ++i) {
+		if (getCell(board, i%10, i/10)) {
+			setPackedCell(packed, i);
+		}
+	}
+}
+
+// 'I' with the whole board, then its acknowledgement
+void sendBoard() {
+	char replyType;
+	if (linkVersion >= 1) {
+		uint8_t packed[PACKED_BOARD];
+		packBoard(packed);
+		sendFrame('I', packed, PACKED_BOARD);
+	} else {
+		string line = "I ";
+		for (int i = 0; i < 200; ++i) {
+			line += getCell(board, i%10, i/10) ? '1' : '0';
+		}
+		sendLine(line);
+	}
+	waitReply('I', replyType);
+}
+
+// tiles of the piece in play
+void pieceTiles(int cells[4][2]) {
+	for (int i = 0; i < 4; ++i) {
+		cells[i][0] = pivotX + pieceCells[piece][rot][i][0];
+		cells[i][1] = pivotY + pieceCells[piece][rot][i][1];
+	}
+}
+
+// 'C' with the piece in play, then its acknowledgement
+void sendPiece() {
+	char replyType;
+	int cells[4][2];
+	pieceTiles(cells);
+	if (linkVersion >= 1) {
+		uint8_t payload[PACKED_PIECE];
+		for (int i = 0; i < 4; ++i) {
+			payload[2*i] = cells[i][0];
+			payload[2*i + 1] = cells[i][1];
+		}
+		payload[8] = rot;
+		sendFrame('C', payload, PACKED_PIECE);
+	} else {
+		string line = "C ";
+		for (int i = 0; i < 4; ++i) {
+			line += to_string(cells[i][0]) + " " + to_string(cells[i][1]) + " ";
+		}
+		sendLine(line + to_string(rot));
+	}
+	waitReply('C', replyType);
+}
+
+// 'L' lock event: the last lock, the piece in play, the board checksum and,
+// from version 4, the level
+void sendLockEvent(int level) {
+	uint8_t payload[MAX_PAYLOAD];
+	uint8_t packed[PACKED_BOARD];
+	int length = 0;
+	payload[length++] = lockPending ? 4 : 0;
+	for (int i = 0; i < 4 && lockPending; ++i) {
+		payload[length++] = lastLock[i][0];
+		payload[length++] = lastLock[i][1];
+	}
+	payload[length++] = piece;
+	packBoard(packed);
+	uint16_t checksum = boardChecksum(packed);
+	payload[length++] = checksum >> 8;
+	payload[length++] = checksum & 0xFF;
+	if (linkVersion >= 4) {
+		payload[length++] = level < 255 ? level : 255;
+	}
+	payload[length++] = upcoming;
+	lockPending = false;
+	sendFrame('L', payload, length);
+}
+
+// deals the next piece at its spawn position; false if it does not fit
+bool spawnPiece() {
+	piece = upcoming;
+	upcoming = nextPiece(gen);
+	rot = 0;
+	pivotX = spawnPivot[piece][0];
+	pivotY = spawnPivot[piece][1];
+	return !collides(board, shapeMask(piece, rot, pivotX, pivotY), 0, 0);
+}
+
+int playMove(int moveInstr) {
+	/*
+		Plays a reply the way the client's ProcessingPiece state does:
+		the 'P' path in movePath if there was one, else turn, shift (a
+		move the wall blocks goes the other way, as on the client); then
+		drop and lock.
+		Parameters:
+			moveInstr (int): tens = signed shift, 90 for none; ones = turns
+		Returns the number of cleared lines.
+	*/
+	if (pathLength >= 0) {
+		for (int i = 0; i < pathLength; ++i) {
+			PieceMask mask = shapeMask(piece, rot, pivotX, pivotY);
+			if (movePath[i] == PATH_LEFT && !collides(board, mask, -1, 0)) {
+				pivotX--;
+			} else if (movePath[i] == PATH_RIGHT && !collides(board, mask, 1, 0)) {
+				pivotX++;
+			} else if (movePath[i] == PATH_CW || movePath[i] == PATH_CCW) {
+				tryRotate(board, piece, rot, pivotX, pivotY, movePath[i] == PATH_CW ? 1 : -1);
+			} else if (movePath[i] == PATH_DROP) {
+				pivotY -= dropDistance(board, mask, 0);
+			}
+		}
+		pathLength = -1;
+	}
+	for (int i = 0; i < abs(moveInstr)%10; ++i) {
+		tryRotate(board, piece, rot, pivotX, pivotY, 1);
+	}
+	for (int i = 0; i < abs(moveInstr/10); ++i) {
+		if (moveInstr/10 != 9) {
+			PieceMask mask = shapeMask(piece, rot, pivotX, pivotY);
+			if (moveInstr > 0 && !collides(board, mask, 1, 0)) {
+				pivotX++;
+			} else if (!collides(board, mask, -1, 0)) {
+				pivotX--;
+			}
+		}
+	}
+	PieceMask mask = shapeMask(piece, rot, pivotX, pivotY);
+	pivotY -= dropDistance(board, mask, 0);
+	mask = shapeMask(piece, rot, pivotX, pivotY);
+	pieceTiles(lastLock);
+	lockPending = true;
+	lockMask(board, mask, 0, 0);
+	return clearLines(board, mask.y, mask.y + mask.height);
+}
+
+// pty pair with the server on the slave end
+bool startServer(char** serverArgs, int numArgs, const char* logPath) {
+	serial = posix_openpt(O_RDWR | O_NOCTTY);
+	if (serial < 0 || grantpt(serial) != 0 || unlockpt(serial) != 0) {
+		cout << "cannot open a pty" << endl;
+		return false;
+	}
+	string slave = ptsname(serial);
+	// raw bytes both ways, like a USB serial line; keeping the slave open
+	// here also stops the master reading EIO before the server opens it
+	int slaveFd = open(slave.c_str(), O_RDWR | O_NOCTTY);
+	termios mode;
+	tcgetattr(slaveFd, &mode);
+	cfmakeraw(&mode);
+	tcsetattr(slaveFd, TCSANOW, &mode);
+
+	serverPid = fork();
+	if (serverPid == 0) {
+		char** args = new char*[numArgs + 4];
+		int count = 0;
+		args[count++] = serverArgs[0];
+		args[count++] = (char*) "-p";
+		args[count++] = (char*) slave.c_str();
+		for (int i = 1; i < numArgs; ++i) {
+			args[count++] = serverArgs[i];
+		}
+		args[count] = 0;
+		int log = open(logPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (log >= 0) {
+			dup2(log, STDOUT_FILENO);
+			close(log);
+		}
+		close(serial);
+		close(slaveFd);
+		execv(args[0], args);
+		_exit(127);
+	}
+	return serverPid > 0;
+}
+
+// connects to a host's unix-domain socket, or opens the slave end of one
+// of its ptys
+bool connectHost(const char* socketPath, const char* device) {
+	if (device) {
+		serial = open(device, O_RDWR | O_NOCTTY);
+		if (serial < 0) {
+			cout << "cannot open " << device << endl;
+			return false;
+		}
+		termios mode;
+		tcgetattr(serial, &mode);
+		cfmakeraw(&mode);
+		tcsetattr(serial, TCSANOW, &mode);
+		return true;
+	}
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	serial = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (serial < 0 || connect(serial, (sockaddr*) &address, sizeof(address)) != 0) {
+		cout << "cannot connect to " << socketPath << endl;
+		return false;
+	}
+	return true;
+}
+
+void printReport(long pieces, long lines, double seconds) {
+	if (sessionId >= 0) {
+		cout << "session " << sessionId << ", ";
+	}
+	cout << "link version " << linkVersion << ", " << pieces << " pieces, " << lines << " lines in "
+		<< seconds << " s (" << pieces / seconds << " pieces/sec)" << endl;
+	cout << "round trip as the client sees it:" << endl;
+	for (int i = 0; i < NUM_TYPES; ++i) {
+		if (roundTrip[i].count() > 0) {
+			string name(1, messageTypes[i]);
+			roundTrip[i].print(cout, name.c_str(), "us");
+		}
+	}
+	cout << "server response (first reply byte):" << endl;
+	for (int i = 0; i < NUM_TYPES; ++i) {
+		if (response[i].count() > 0) {
+			string name(1, messageTypes[i]);
+			response[i].print(cout, name.c_str(), "us");
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	/*
+		Plays the Arduino client's side of the serial protocol against a
+		real server over a pseudo-terminal, and reports the latency of
+		every message type.
+		Usage: virtualClient [-n pieces] [-s seed] [-v version] [-g level] [-o log] [-t limit] <server> [serverArgs...]
+			virtualClient [options] -u <socket> | -d <device>
+			pieces: stop after this many pieces, default 1000
+			seed: piece sequence seed, default 1
+			version: frame version to ask for; 0 keeps the ASCII protocol,
+				default FRAME_VERSION
+			level: level the game starts at, reported in version 4 lock
+				events and raised every 10 lines like the client's,
+				default 0
+			log: where the server's output goes, default /dev/null
+			limit: exit with 2 if any message type's p99 server response
+				is over this many microseconds
+			server, serverArgs: server binary and its own arguments; the
+				pty is passed as -p <device>
+			socket: play against a running host over its unix-domain
+				socket instead of starting a server
+			device: play against a running host over one of its ptys
+	*/
+	long maxPieces = DEFAULT_MAX_PIECES;
+	uint64_t seed = 1;
+	int version = FRAME_VERSION;
+	int startLevel = 0;
+	const char* logPath = "/dev/null";
+	long limit = 0;
+	const char* socketPath = 0;
+	const char* device = 0;
+	int first = 1;
+	while (first + 1 < argc && argv[first][0] == '-') {
+		string option = argv[first];
+		if (option == "-n") {
+			maxPieces = atol(argv[first + 1]);
+		} else if (option == "-s") {
+			seed = strtoull(argv[first + 1], 0, 10);
+		} else if (option == "-v") {
+			version = atoi(argv[first + 1]);
+		} else if (option == "-g") {
+			startLevel = atoi(argv[first + 1]);
+		} else if (option == "-o") {
+			logPath = argv[first + 1];
+		} else if (option == "-t") {
+			limit = atol(argv[first + 1]);
+		} else if (option == "-u") {
+			socketPath = argv[first + 1];
+		} else if (option == "-d") {
+			device = argv[first + 1];
+		} else {
+			break;
+		}
+		first += 2;
+	}
+	bool hosted = socketPath || device;
+	if (first >= argc && !hosted) {
+		cout << "usage: virtualClient [-n pieces] [-s seed] [-v version] [-g level] [-o log] [-t limit] <server> [serverArgs...]" << endl;
+		cout << "       virtualClient [options] -u <socket> | -d <device>" << endl;
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (hosted ? !connectHost(socketPath, device) : !startServer(argv + first, argc - first, logPath)) {
+		return 1;
+	}
+
+	seedGenerator(gen, seed);
+	clearBoard(board);
+	upcoming = nextPiece(gen);
+	spawnPiece();
+	int64_t start = nowMicros();
+	long pieces = 0;
+	long lines = 0;
+	int moveInstr = 0;
+	char replyType;
+
+	// AI switched on: the same sequence as the client
+	negotiate(version);
+	bool sending;
+	if (linkVersion >= 2) {
+		sendBoard();
+		sending = false;
+	} else {
+		sendBoard();
+		sendPiece();
+		sending = true;
+	}
+	while (true) {
+		if (sending) {
+			char type = linkVersion >= 2 ? 'L' : 'R';
+			if (linkVersion >= 2) {
+				sendLockEvent(startLevel + lines/10);
+			} else if (linkVersion >= 1) {
+				uint8_t preview = upcoming;
+				sendFrame('R', &preview, 1);
+			} else {
+				sendLine("R " + to_string(upcoming));
+			}
+			moveInstr = waitReply(type, replyType);
+			if (replyType == 'S') {
+				sendBoard();
+				lockPending = false;
+				continue;
+			}
+		}
+		sending = true;
+		lines += playMove(moveInstr);
+		pieces++;
+		if (board.rows[BOARD_HEIGHT - 1] != 0 || pieces >= maxPieces || !spawnPiece()) {
+			break;
+		}
+	}
+	if (linkVersion >= 1) {
+		sendFrame('X', 0, 0);
+	} else {
+		sendLine("X\n");
+	}
+	double seconds = (nowMicros() - start) / 1e6;
+	int status = 0;
+	if (hosted) {
+		// the host keeps running for its other sessions
+		close(serial);
+	} else {
+		waitpid(serverPid, &status, 0);
+	}
+	printReport(pieces, lines, seconds);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		cout << "server did not exit cleanly" << endl;
+		return 1;
+	}
+	for (int i = 0; i < NUM_TYPES && limit > 0; ++i) {
+		if (response[i].count() > 0 && response[i].percentile(0.99) > limit) {
+			cout << messageTypes[i] << " p99 over the limit of " << limit << " us" << endl;
+			return 2;
+		}
+	}
+	return 0;
+}